@@ -1,357 +1,4091 @@
+#ifdef EC_USE_GUROBI
 #include "gurobi_c++.h"
+#endif
 #include "bits/stdc++.h"
 #include "math.h"
 #include <queue>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
 using namespace std;
 
-// Branch-and-Bound node
+// Query-to-server assignment: server[j] is the ES of query j, or CLOUD, or
+// FREE while query j is undecided in a partial assignment
+typedef vector<int16_t> Assignment;
+const int16_t CLOUD = -1;
+const int16_t FREE = -2;
+
+// Allocator for the coefficient tables and the relaxation iterates: 64-byte
+// aligned so that every row of kp doubles starts on a cache line
+template <class T>
+struct AlignedAllocator
+{
+     typedef T value_type;
+     AlignedAllocator() {}
+     template <class U>
+     AlignedAllocator(const AlignedAllocator<U> &) {}
+     T *allocate(size_t count)
+     {
+          void *p = nullptr;
+          if (posix_memalign(&p, 64, max<size_t>(count, 1) * sizeof(T)) != 0)
+               throw bad_alloc();
+          return static_cast<T *>(p);
+     }
+     void deallocate(T *p, size_t) { free(p); }
+     bool operator==(const AlignedAllocator &) const { return true; }
+     bool operator!=(const AlignedAllocator &) const { return false; }
+};
+typedef vector<double, AlignedAllocator<double>> AlignedVector;
+
+// Instance data laid out for the hot loops, built once after the bandwidth
+// test. Rows are padded to kp (a multiple of 8) with zeros, so the kernels
+// below never need a remainder loop on a row.
+struct Coefficients
+{
+     int kp;
+     AlignedVector a;          // e[j][i] * sqrt(c[j]), n x kp
+     AlignedVector mask;       // e[j][i] as 0.0 / 1.0, n x kp
+     AlignedVector invF;       // 1 / F[i], zero in the padding
+     vector<double> sqrtC;     // sqrt(c[j])
+     vector<double> costEdge;  // w[j] / r_nk_e
+     vector<double> costCloud; // w[j] / r_nk_c
+     vector<double> lin;       // costEdge[j] - costCloud[j]
+     vector<double> minCost;   // least transfer cost of query j, edge only if executable somewhere
+     vector<int> byRatio;      // queries that save by the edge, by decreasing saving per load -lin / sqrtC
+     vector<int> bySize;       // queries by decreasing sqrt(c[j])
+     vector<int> impactOrder;  // static branching order, see buildCoefficients
+     vector<int> impactRank;   // position of each query in impactOrder
+     vector<int> serverClass;  // lowest index of the servers with the same F and e column
+     vector<int> groupHead;    // first query with the same c, w and e row
+     vector<int> groupNext;    // next query of that group, -1 for the last
+     vector<int> groupHeads;   // first query of every such group of two or more
+     double loadQuantum;       // resolution of the loads in the transposition keys
+};
+
+// Vector kernels over len doubles. len is a multiple of 8 for rows of the
+// tables; the scalar tail only runs on whole-range calls.
+#if defined(__AVX512F__)
+#include <immintrin.h>
+const char *simdName = "avx512";
+
+inline double dot(const double *u, const double *v, size_t len)
+{
+     __m512d acc = _mm512_setzero_pd();
+     size_t i = 0;
+     for (; i + 8 <= len; i += 8)
+          acc = _mm512_fmadd_pd(_mm512_loadu_pd(u + i), _mm512_loadu_pd(v + i), acc);
+     // Summed from memory: _mm512_reduce_add_pd extracts through an
+     // uninitialized register that -Wall reports
+     double lane[8];
+     _mm512_storeu_pd(lane, acc);
+     double s = 0.0;
+     for (int t = 0; t < 8; t++)
+          s += lane[t];
+     for (; i < len; i++)
+          s += u[i] * v[i];
+     return s;
+}
+
+// out += u * v
+inline void multiplyAdd(double *out, const double *u, const double *v, size_t len)
+{
+     size_t i = 0;
+     for (; i + 8 <= len; i += 8)
+          _mm512_storeu_pd(out + i, _mm512_fmadd_pd(_mm512_loadu_pd(u + i), _mm512_loadu_pd(v + i),
+                                                    _mm512_loadu_pd(out + i)));
+     for (; i < len; i++)
+          out[i] += u[i] * v[i];
+}
+
+// out = alpha * u + beta * v
+inline void lincomb(double *out, const double *u, const double *v, double alpha, double beta, size_t len)
+{
+     __m512d va = _mm512_set1_pd(alpha), vb = _mm512_set1_pd(beta);
+     size_t i = 0;
+     for (; i + 8 <= len; i += 8)
+          _mm512_storeu_pd(out + i, _mm512_fmadd_pd(va, _mm512_loadu_pd(u + i),
+                                                    _mm512_mul_pd(vb, _mm512_loadu_pd(v + i))));
+     for (; i < len; i++)
+          out[i] = alpha * u[i] + beta * v[i];
+}
+
+// g = mask * (scaled * a + lin)
+inline void gradientRow(double *g, const double *scaled, const double *a, const double *mask,
+                        double lin, size_t len)
+{
+     __m512d vl = _mm512_set1_pd(lin);
+     for (size_t i = 0; i < len; i += 8)
+          _mm512_storeu_pd(g + i, _mm512_mul_pd(_mm512_loadu_pd(mask + i),
+                                                _mm512_fmadd_pd(_mm512_loadu_pd(scaled + i),
+                                                                _mm512_loadu_pd(a + i), vl)));
+}
+#elif defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+const char *simdName = "avx2";
+
+inline double dot(const double *u, const double *v, size_t len)
+{
+     __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+     size_t i = 0;
+     for (; i + 8 <= len; i += 8)
+     {
+          acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(u + i), _mm256_loadu_pd(v + i), acc0);
+          acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(u + i + 4), _mm256_loadu_pd(v + i + 4), acc1);
+     }
+     double lane[4];
+     _mm256_storeu_pd(lane, _mm256_add_pd(acc0, acc1));
+     double s = lane[0] + lane[1] + lane[2] + lane[3];
+     for (; i < len; i++)
+          s += u[i] * v[i];
+     return s;
+}
+
+// out += u * v
+inline void multiplyAdd(double *out, const double *u, const double *v, size_t len)
+{
+     size_t i = 0;
+     for (; i + 4 <= len; i += 4)
+          _mm256_storeu_pd(out + i, _mm256_fmadd_pd(_mm256_loadu_pd(u + i), _mm256_loadu_pd(v + i),
+                                                    _mm256_loadu_pd(out + i)));
+     for (; i < len; i++)
+          out[i] += u[i] * v[i];
+}
+
+// out = alpha * u + beta * v
+inline void lincomb(double *out, const double *u, const double *v, double alpha, double beta, size_t len)
+{
+     __m256d va = _mm256_set1_pd(alpha), vb = _mm256_set1_pd(beta);
+     size_t i = 0;
+     for (; i + 4 <= len; i += 4)
+          _mm256_storeu_pd(out + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(u + i),
+                                                    _mm256_mul_pd(vb, _mm256_loadu_pd(v + i))));
+     for (; i < len; i++)
+          out[i] = alpha * u[i] + beta * v[i];
+}
+
+// g = mask * (scaled * a + lin)
+inline void gradientRow(double *g, const double *scaled, const double *a, const double *mask,
+                        double lin, size_t len)
+{
+     __m256d vl = _mm256_set1_pd(lin);
+     for (size_t i = 0; i < len; i += 4)
+          _mm256_storeu_pd(g + i, _mm256_mul_pd(_mm256_loadu_pd(mask + i),
+                                                _mm256_fmadd_pd(_mm256_loadu_pd(scaled + i),
+                                                                _mm256_loadu_pd(a + i), vl)));
+}
+#else
+const char *simdName = "scalar";
+
+inline double dot(const double *u, const double *v, size_t len)
+{
+     double s = 0.0;
+     for (size_t i = 0; i < len; i++)
+          s += u[i] * v[i];
+     return s;
+}
+
+// out += u * v
+inline void multiplyAdd(double *out, const double *u, const double *v, size_t len)
+{
+     for (size_t i = 0; i < len; i++)
+          out[i] += u[i] * v[i];
+}
+
+// out = alpha * u + beta * v
+inline void lincomb(double *out, const double *u, const double *v, double alpha, double beta, size_t len)
+{
+     for (size_t i = 0; i < len; i++)
+          out[i] = alpha * u[i] + beta * v[i];
+}
+
+// g = mask * (scaled * a + lin)
+inline void gradientRow(double *g, const double *scaled, const double *a, const double *mask,
+                        double lin, size_t len)
+{
+     for (size_t i = 0; i < len; i++)
+          g[i] = mask[i] * (scaled[i] * a[i] + lin);
+}
+#endif
+
+// Sum of load[i]^2 * invF[i]
+inline double weightedSquares(const double *load, const double *invF, size_t len)
+{
+     double s = 0.0;
+     for (size_t i = 0; i < len; i++)
+          s += load[i] * load[i] * invF[i];
+     return s;
+}
+
+// Bytes held by the live warm starts, for the memory budget of the search
+atomic<long long> warmStartBytes{0};
+
+// Relaxed solution of a solved node, used to warm-start its children. It is
+// held by every open node, so the basis statuses (0..-3) are kept as bytes
+// and the primal values only when no basis is available.
+struct WarmStart
+{
+     vector<int8_t> vbasis, cbasis;  // simplex basis in the order of buildModel
+     vector<float> x;                // D values if there is no basis
+     vector<float> lambda;           // Lagrange multipliers of the rows
+     long long counted = 0;          // bytes added to warmStartBytes
+
+     // Adds the filled vectors to warmStartBytes, once
+     void count()
+     {
+          counted = vbasis.size() + cbasis.size() + (x.size() + lambda.size()) * sizeof(float);
+          warmStartBytes.fetch_add(counted, memory_order_relaxed);
+     }
+     ~WarmStart() { warmStartBytes.fetch_sub(counted, memory_order_relaxed); }
+};
+
+// Options ruled out by reduced-cost fixing, one bit per query and option:
+// bit j * (k + 1) + i + 1 for server i, j * (k + 1) for the cloud
+typedef vector<uint64_t> Exclusions;
+
+// Branch-and-Bound node. Only the decision that created it is stored; the
+// assignment of its Nd_num fixed queries is rebuilt by following the parent
+// links up to the root (see NodeArena::assignment).
 struct node
 {
-     double upper;
+     double lower;
+     uint32_t parent;   // NodeArena::NONE for the root
+     int query;         // query decided by this node, -1 for the root
+     int16_t server;    // its edge server or CLOUD
+     int Nd_num;        // number of fixed queries (the depth)
+     int branch;        // most fractional query of its relaxation, -1 if none
+     uint32_t saved;    // its index in the checkpoint file's tree, NodeArena::NONE if not there
+     double cost;       // transfer cost (edge or cloud) of the fixed queries
+     double fixed;      // objective of the fixed queries alone
+     uint64_t hash;     // Zobrist key of the fixed queries, see queryKey
+     bool solved;       // false while lower is only inherited (lazy evaluation)
+     atomic<int> refs;  // live children, plus one while the node is open
+     shared_ptr<const WarmStart> warm;  // this node's relaxed solution, its parent's until solved
+     shared_ptr<const Exclusions> excluded;  // options excluded in the subtree, null if none
+};
+
+// Pooled storage for the search tree. Nodes live in fixed-size chunks that
+// are never moved, so ids stay valid while other workers allocate; freed
+// slots are recycled. A node is freed once it is closed and all its children
+// are gone, which in turn releases its parent. Next to every node the arena
+// keeps the per-server loads of its fixed queries.
+class NodeArena
+{
+public:
+     static const uint32_t NONE = UINT32_MAX;
+
+     explicit NodeArena(int k) : k(k), chunks(MAX_CHUNKS), loadChunks(MAX_CHUNKS) {}
+
+     node& operator[](uint32_t id) { return chunks[id >> CHUNK_BITS][id & CHUNK_MASK]; }
+     // sum of e[j][i] * sqrt(c[j]) over the fixed queries j on server i
+     double* load(uint32_t id) { return &loadChunks[id >> CHUNK_BITS][(size_t)(id & CHUNK_MASK) * k]; }
+
+     uint32_t alloc(uint32_t parent, int query, int16_t server, int Nd_num, double lower);
+     void release(uint32_t id);
+     // Frees every node at once; the chunks stay allocated for the next search
+     void clear();
+     // Writes the decisions on the path to id into d, FREE elsewhere
+     void assignment(uint32_t id, Assignment& d);
+
+     size_t live() const { return liveCnt.load(memory_order_relaxed); }
+     size_t peak() const { return peakCnt.load(memory_order_relaxed); }
+
+private:
+     static const int CHUNK_BITS = 14;
+     static const uint32_t CHUNK_MASK = (1u << CHUNK_BITS) - 1;
+     static const size_t MAX_CHUNKS = 1u << (32 - CHUNK_BITS);
+
+     int k;
+     vector<unique_ptr<node[]>> chunks;
+     vector<unique_ptr<double[]>> loadChunks;
+     uint32_t used = 0;        // slots handed out so far
+     vector<uint32_t> freeIds;
+     mutex m;
+     atomic<size_t> liveCnt{0}, peakCnt{0};
+};
+
+// A node as seen by the bounding code: its fixed queries (the entries of d
+// other than FREE) and their aggregates, so that the fixed part of the
+// objective costs O(k) instead of O(n k), and the list of the free ones.
+struct PartialAssignment
+{
+     const Assignment *d;
+     int Nd_num;
+     const double *load;   // per-server loads of the fixed queries
+     double cost;          // their transfer cost
+     const vector<int> *free;
+     const Exclusions *excluded = nullptr;   // servers the relaxation may drop
+};
+
+// Frontier entry: the sort key and the arena id of an open node
+struct OpenNode
+{
      double lower;
      int Nd_num;
-     vector<vector<int>> d;
-     vector<vector<int>> d_upper;
+     uint32_t id;
+};
+
+// Solver used for the node relaxations
+enum Backend
+{
+     BACKEND_GUROBI,  // QP solved by Gurobi
+     BACKEND_NATIVE   // built-in projected gradient solver, no license needed
+};
+
+// Lower bound computed at a node
+enum BoundMode
+{
+     BOUND_QP,          // continuous relaxation by the backend
+     BOUND_LAGRANGIAN,  // Lagrangian bound only
+     BOUND_AUTO         // Lagrangian first, the QP only if the node survives it
+};
+
+// Query a node branches on
+enum BranchRule
+{
+     BRANCH_INPUT,       // first free query in input order
+     BRANCH_IMPACT,      // first free query by static impact (see buildCoefficients)
+     BRANCH_FRACTIONAL,  // most fractional row of the node's relaxation
+     BRANCH_PSEUDOCOST   // largest bound gain seen so far on the query
+};
+
+// Solver of the whole problem
+enum Engine
+{
+     ENGINE_BB,    // the branch-and-bound below
+     ENGINE_MIQP,  // Gurobi's MIQP branch-and-cut on the full binary model
+     ENGINE_BOTH,  // both from the same start, reported side by side
+     ENGINE_LNS    // large neighborhood search, for instances beyond the exact search
+};
+
+// Node selection rule of the branch-and-bound driver
+enum SearchMode
+{
+     SEARCH_BFS,  // FIFO, explores the tree level by level
+     SEARCH_BEST  // pops the node with the lowest lower bound first
+};
+
+struct SolverOptions
+{
+     Engine engine = ENGINE_BB;
+     SearchMode search = SEARCH_BEST;
+     BranchRule branch = BRANCH_IMPACT;
+#ifdef EC_USE_GUROBI
+     Backend backend = BACKEND_GUROBI;
+#else
+     Backend backend = BACKEND_NATIVE;
+#endif
+     int nativeIters = 2000;       // iteration cap of the native solver
+     double nativeTol = 1e-6;      // relative duality gap it stops at
+     BoundMode bound = BOUND_QP;
+     int lagrangeIters = 20;       // subgradient steps per node
+     int threads = max(1u, thread::hardware_concurrency());
+     bool warmStart = true;
+     bool heuristics = true;       // greedy + local search at the root
+     int heuristicFreq = 50;       // and every that many nodes per worker, 0: root only
+     bool symmetry = true;         // skip children equivalent by server symmetry
+     bool presolve = true;         // reduce the instance before the search
+     double timeLimit = 0.0;       // seconds of search, 0: none
+     long long nodeLimit = 0;      // nodes expanded, 0: none
+     double gap = 0.0;             // relative gap the search stops at
+     double absGap = 0.0;          // absolute gap the search stops at
+     bool lazy = true;             // solve children when they are popped, not when created
+     bool cascade = true;          // analytic bounds before the relaxation
+     int ttMB = 16;                // transposition table size, 0: off
+     bool reducedCost = true;      // reduced-cost fixing from the relaxation
+     long long memMB = 0;          // memory budget of the open nodes, 0: half the physical memory
+     string checkpoint;            // file the search state is saved to, empty: none
+     double checkpointEvery = 5.0; // seconds between two checkpoints
+     bool resume = false;          // continue the search saved in checkpoint
+     int serve = 0;                // TCP port of the distributed coordinator, 0: none
+     string connect;               // host:port of the coordinator this process works for
+     long long distNodes = 1000;   // node limit of a distributed worker's subtree
+     int lnsSize = 12;             // queries freed per LNS neighborhood
+     long long lnsNodes = 200;     // node limit of a neighborhood's search
+     bool verbose = false;
+};
+
+SolverOptions opts;
+
+// Orders the best-first heap: lowest lower bound on top, ties go to the
+// deeper node so that complete assignments (and new incumbents) surface early.
+struct NodeCompare
+{
+     bool operator()(const OpenNode& a, const OpenNode& b) const
+     {
+          if (a.lower != b.lower)
+               return a.lower > b.lower;
+          return a.Nd_num < b.Nd_num;
+     }
+};
+
+// Open nodes of the search tree, FIFO or best-first depending on the mode
+class Frontier
+{
+public:
+     explicit Frontier(SearchMode mode) : mode(mode) {}
+
+     void push(const OpenNode& p)
+     {
+          if (mode == SEARCH_BFS)
+               fifo.push_back(p);
+          else
+               heap.push(p);
+     }
+
+     OpenNode pop()
+     {
+          OpenNode p;
+          if (mode == SEARCH_BFS)
+          {
+               p = fifo.front();
+               fifo.pop_front();
+          }
+          else
+          {
+               p = heap.top();
+               heap.pop();
+          }
+          return p;
+     }
+
+     // Taken by other workers: the newest node in BFS mode so the owner keeps
+     // its level order, the best node in best-first mode.
+     OpenNode steal()
+     {
+          OpenNode p;
+          if (mode == SEARCH_BFS)
+          {
+               p = fifo.back();
+               fifo.pop_back();
+          }
+          else
+          {
+               p = heap.top();
+               heap.pop();
+          }
+          return p;
+     }
+
+     // Least lower bound of the open nodes, infinity if there are none
+     double minLower() const
+     {
+          double lo = numeric_limits<double>::infinity();
+          if (mode == SEARCH_BEST)
+               return heap.empty() ? lo : heap.top().lower;
+          for (const OpenNode &p : fifo)
+               lo = min(lo, p.lower);
+          return lo;
+     }
+
+     bool empty() const { return mode == SEARCH_BFS ? fifo.empty() : heap.empty(); }
+     size_t size() const { return mode == SEARCH_BFS ? fifo.size() : heap.size(); }
+
+     // Drops the open nodes, keeping the storage
+     void clear()
+     {
+          fifo.clear();
+          heap.clear();
+     }
+
+     // Appends every open node to out, in no particular order
+     void copyTo(vector<OpenNode> &out) const
+     {
+          if (mode == SEARCH_BFS)
+               out.insert(out.end(), fifo.begin(), fifo.end());
+          else
+               out.insert(out.end(), heap.items().begin(), heap.items().end());
+     }
+
+private:
+     // Exposes the heap's container for copyTo
+     struct Heap : priority_queue<OpenNode, vector<OpenNode>, NodeCompare>
+     {
+          const vector<OpenNode> &items() const { return c; }
+          void clear() { c.clear(); }
+     };
+
+     SearchMode mode;
+     deque<OpenNode> fifo;
+     Heap heap;
+};
+
+// 64-bit mixer (splitmix64 finalizer) for the transposition keys
+inline uint64_t mix64(uint64_t x)
+{
+     x += 0x9e3779b97f4a7c15ULL;
+     x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+     x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+     return x ^ (x >> 31);
+}
+
+// Transposition table. Nodes with the same free queries and the same
+// per-server loads have the same completions up to the transfer cost of
+// their fixed queries, so only the cheapest of them needs a search. The
+// table has a fixed size: buckets of WAYS entries, replaced round-robin,
+// guarded by striped locks.
+class TranspositionTable
+{
+public:
+     explicit TranspositionTable(size_t bytes)
+         : buckets(max<size_t>(1, bytes / (WAYS * sizeof(Entry)))), entries(buckets * WAYS), next(buckets, 0) {}
+
+     // False if a node of this state and no higher cost was seen before;
+     // otherwise records the node and returns true
+     bool visit(uint64_t key, double cost)
+     {
+          key |= 1;   // 0 marks an empty entry
+          size_t b = key % buckets;
+          Entry *bucket = &entries[b * WAYS];
+          double eps = 1e-9 * max(1.0, fabs(cost));
+          lock_guard<mutex> lock(locks[b % STRIPES]);
+          for (int t = 0; t < WAYS; t++)
+          {
+               if (bucket[t].key != key)
+                    continue;
+               if (bucket[t].cost <= cost + eps)
+                    return false;
+               bucket[t].cost = cost;
+               return true;
+          }
+          Entry &slot = bucket[next[b]];
+          next[b] = (next[b] + 1) % WAYS;
+          slot.key = key;
+          slot.cost = cost;
+          return true;
+     }
+
+     size_t bytes() const { return entries.size() * sizeof(Entry); }
+
+     void clear()
+     {
+          fill(entries.begin(), entries.end(), Entry());
+          fill(next.begin(), next.end(), 0);
+     }
+
+private:
+     static const int WAYS = 4;
+     static const int STRIPES = 256;
+     struct Entry
+     {
+          uint64_t key = 0;
+          double cost = 0.0;
+     };
+     size_t buckets;
+     vector<Entry> entries;
+     vector<uint8_t> next;
+     mutex locks[STRIPES];
+};
+
+// Best complete assignment found so far, shared by all workers. The value is
+// read lock-free for pruning, the assignment is only touched under the mutex.
+class Incumbent
+{
+public:
+     Incumbent(double value, const Assignment& D) : value(value), D(D) {}
+
+     double get() const { return value.load(memory_order_acquire); }
+
+     bool offer(double val, const Assignment& d)
+     {
+          if (val >= get())
+               return false;
+          lock_guard<mutex> lock(m);
+          if (val >= value.load(memory_order_relaxed))
+               return false;
+          D = d;
+          value.store(val, memory_order_release);
+          return true;
+     }
+
+     Assignment assignment()
+     {
+          lock_guard<mutex> lock(m);
+          return D;
+     }
+
+     // Starts over from val and d, even if they are worse
+     void reset(double val, const Assignment& d)
+     {
+          lock_guard<mutex> lock(m);
+          D = d;
+          value.store(val, memory_order_release);
+     }
+
+private:
+     atomic<double> value;
+     mutex m;
+     Assignment D;
+};
+
+// Continuous relaxation of a node, one instance per worker. The returned
+// value must be a valid lower bound of every completion of the node.
+class Relaxation
+{
+public:
+     virtual ~Relaxation() {}
+     // Solves the relaxation of the node part, starting from the parent's
+     // solution when given. The rounded solution goes to d_upper and, with
+     // warm starts on, the relaxed one to warm.
+     virtual double solve(const PartialAssignment &part, const WarmStart *start,
+                          Assignment &d_upper, WarmStart *warm) = 0;
+     double iterations = 0.0;       // solver iterations so far
+     // Incumbent value: once the bound exceeds it the node is pruned, so
+     // the solver may stop there
+     double cutoff = numeric_limits<double>::infinity();
+     // Free query whose relaxed row is farthest from integral, -1 if none
+     int fractional = -1;
+     // Per free query j, n x (k+1) laid out as Exclusions: a lower bound of
+     // the node's completions that give j that option, from the reduced costs
+     // of the last solve; empty if it has none
+     vector<double> optionLower;
+};
+
+// Structure-exploiting solver for the relaxation: accelerated projected
+// gradient (FISTA) over the free rows, each projected onto
+// {x >= 0, sum_i x_i <= 1}. The bound it returns is the Frank-Wolfe dual
+// bound f(x) + min_s g(x)'(s - x), which is valid at any iterate, so an early
+// stop only loosens the bound.
+class NativeRelaxation : public Relaxation
+{
+public:
+     NativeRelaxation();
+     double solve(const PartialAssignment &part, const WarmStart *start,
+                  Assignment &d_upper, WarmStart *warm) override;
+
+private:
+     AlignedVector x, y, xPrev, g, load, scaled;  // rows of coef.kp
+     vector<double> sorted;
+     double objective(const AlignedVector &v, const vector<int> &free, const double *fixedLoad);
+     void gradient(const AlignedVector &v, const vector<int> &free, const double *fixedLoad);
+     void project(double *row, int j, const Exclusions *ex);
+};
+
+// Lagrangian bound: with the rows sum_i D[j][i] <= 1 dualized by lambda_j >= 0
+// the relaxation splits into one problem per server, each solved exactly in
+// O(m log m). Any lambda gives a valid bound; subgradient steps (Polyak step
+// towards the incumbent) improve it, starting from the parent's multipliers.
+class LagrangianBound : public Relaxation
+{
+public:
+     LagrangianBound();
+     double solve(const PartialAssignment &part, const WarmStart *start,
+                  Assignment &d_upper, WarmStart *warm) override;
+
+private:
+     vector<double> lambda, bestLambda, x;  // x: subproblem solutions, n x k
+     vector<int> items;
+     double server(int i, const vector<int> &free, double L0);
+};
+
+// Outcome of a solve engine, for the side-by-side report
+struct EngineStats
+{
+     double value = numeric_limits<double>::infinity();
+     double bound = -numeric_limits<double>::infinity();
+     double nodes = 0.0;
+     long long ms = 0;
+     const char *status = "optimal";  // or the limit that stopped the engine
+};
+
+#ifdef EC_USE_GUROBI
+// Adds D[j][i] of type vtype to model, row-major n x k, followed by the k
+// server loads y_i, with the rows sum_i D[j][i] <= 1 followed by the k load
+// definitions, and the objective of the problem
+void buildModel(GRBModel &model, char vtype, vector<GRBVar> &D, vector<GRBConstr> &rows);
+
+// Continuous relaxation kept alive for a whole worker: every D[j][i] of the
+// instance is a variable, and a node is applied by fixing the bounds of its
+// decided rows, so a B&B node costs a few bound changes plus a re-solve.
+class GurobiRelaxation : public Relaxation
+{
+public:
+     explicit GurobiRelaxation(GRBEnv &env);
+     double solve(const PartialAssignment &part, const WarmStart *start,
+                  Assignment &d_upper, WarmStart *warm) override;
+
+private:
+     GRBModel model;
+     vector<GRBVar> D;              // row-major n x k, then the loads, see buildModel
+     vector<GRBConstr> rows;        // sum_i D[j][i] <= 1, then the load definitions
+     vector<double> curLB, curUB;   // bounds currently set on the model
+};
+#endif
+
+// Pseudo-costs shared by all workers: the average bound gains seen when
+// branching on each query, of the best child and of all children. A query
+// scores the product of the two; queries not branched on yet get the
+// average score, and ties go to the static impact order.
+class PseudoCosts
+{
+public:
+     explicit PseudoCosts(int n) : minGain(n), meanGain(n), count(n) {}
+
+     void update(int j, double parentLower, const vector<double> &childLower)
+     {
+          if (childLower.empty())
+               return;
+          double lo = numeric_limits<double>::infinity(), sum = 0.0;
+          for (double l : childLower)
+          {
+               double gain = max(0.0, l - parentLower);
+               lo = min(lo, gain);
+               sum += gain;
+          }
+          lock_guard<mutex> lock(m);
+          if (count[j] > 0)
+               scoreSum -= score(j);
+          else
+               seen++;
+          count[j]++;
+          minGain[j] += (lo - minGain[j]) / count[j];
+          meanGain[j] += (sum / childLower.size() - meanGain[j]) / count[j];
+          scoreSum += score(j);
+     }
+
+     int select(const vector<int> &free);
+
+     void clear()
+     {
+          fill(minGain.begin(), minGain.end(), 0.0);
+          fill(meanGain.begin(), meanGain.end(), 0.0);
+          fill(count.begin(), count.end(), 0);
+          scoreSum = 0.0;
+          seen = 0;
+     }
+
+private:
+     mutex m;
+     vector<double> minGain, meanGain;
+     vector<int> count;
+     double scoreSum = 0.0;
+     int seen = 0;
+
+     double score(int j) const { return max(minGain[j], 1e-6) * max(meanGain[j], 1e-6); }
+};
+
+// Child of the node being expanded, before it is allocated in the arena
+struct Child
+{
+     int16_t server;
+     double lower;
+     int branch;
+     shared_ptr<const WarmStart> warm;
+     shared_ptr<const Exclusions> excluded;
+};
+
+// Search thread state: its own open nodes (guarded by m so that idle
+// workers can steal from it), its own Gurobi model and scratch assignments
+// that are reused for every node it expands.
+struct Worker
+{
+     int id;
+     Relaxation *relax;             // null with --bound=lagrangian
+     Relaxation *lagrangian;        // null with --bound=qp
+     mutex m;
+     Frontier Q;
+     // Open nodes of the current dive, newest last: over the memory budget a
+     // worker takes the best node of Q and searches its subtree depth-first,
+     // which keeps O(depth k) nodes open, before it takes the next one
+     vector<OpenNode> dive;
+     bool diving = false;
+     Assignment d, d_upper, heur;
+     vector<double> load, heurLoad, target;   // target: scratch of calcTargetVal
+     vector<int> free, childFree;   // free queries of the node and of its children
+     vector<char> blocked;          // see groupBounds
+     vector<Child> children;        // scratch of processNode
+     vector<double> lowers;         // and the bounds of its children
+     int fractional = -1;           // of the last relaxation solved
+     double current = numeric_limits<double>::infinity();  // lower bound of the node being expanded
+     uint32_t currentId = UINT32_MAX;   // and its arena id, NodeArena::NONE if none
+     long long expanded = 0;
+     long long pruned = 0;
+     long long stolen = 0;
+     long long symmetric = 0;       // children skipped as mirror images
+     long long solved = 0;          // relaxations solved
+     long long skipped = 0;         // lazy nodes dropped before their relaxation
+     long long tierPruned[3] = {0, 0, 0};  // nodes pruned by each bound tier, see calcProblem
+     long long transposed = 0;      // children pruned by the transposition table
+     long long dives = 0;           // subtrees searched depth-first
+     long long dived = 0;           // nodes expanded in them
+     long long rcFixed = 0;         // options excluded by reduced costs
+     long long rcSkipped = 0;       // children not created for them
+     vector<int> servers;           // scratch of analyticBound
+
+     Worker(int id, Relaxation *relax, Relaxation *lagrangian)
+         : id(id), relax(relax), lagrangian(lagrangian), Q(opts.search) {}
+};
+
+// Search state saved with --checkpoint: the open nodes as paths of decisions
+// from the root, stored once per distinct prefix, so a node costs 10 bytes
+// plus 12 for its bound. Warm starts are not saved; the open nodes are
+// solved again when they are popped after --resume. The file holds a full
+// checkpoint followed by deltas, see SearchPool::saveCheckpoint.
+struct Checkpoint
+{
+     uint64_t instance = 0;       // Presolve::hash of the instance saved
+     double r_nk_e = 0.0, r_nk_c = 0.0;
+     Assignment D;                // incumbent of the core
+     long long expanded = 0;      // nodes expanded before the checkpoint
+     vector<uint32_t> parent;     // decision tree, parents first, 0 is the root
+     vector<int32_t> query;
+     vector<int16_t> server;
+     vector<uint32_t> open;       // tree index of the open nodes
+     vector<double> lower;        // and their lower bounds
+};
+
+Checkpoint resumed;   // read by main with --resume
+
+// Distributed branch-and-bound over TCP. The coordinator (--serve) holds the
+// incumbent and the open subtrees; worker processes (--connect) take the best
+// subtree, search it for up to --dist-nodes nodes and return the open nodes
+// left, together with their incumbent. Every message is a checkpoint: the
+// welcome carries the instance hash, the bandwidths and the incumbent, work
+// is a subtree's path, a result the open nodes left. A worker only ever
+// waits for the reply to its own message, so blocking sockets suffice.
+enum Message : uint32_t
+{
+     MSG_WELCOME,   // coordinator -> new worker
+     MSG_WORK,      // coordinator -> worker: one subtree and the incumbent
+     MSG_RESULT,    // worker -> coordinator: the open nodes left, empty for the first request
+     MSG_DONE       // coordinator -> worker: no more work
+};
+
+// Work-stealing branch-and-bound: every worker expands nodes from its own
+// frontier and steals from the others when it runs dry. pending counts nodes
+// that are queued or being expanded; the search is over when it drops to 0,
+// or when a time, node or gap limit stops it early.
+class SearchPool
+{
+public:
+     // Takes over shared if given, else allocates a table of --tt-mb
+     SearchPool(int threads, Incumbent& incumbent, unique_ptr<TranspositionTable> shared = nullptr);
+     // Searches from a root whose servers already carry rootLoad (none if
+     // null), or from the open nodes of from; --time-limit counts from since
+     void run(chrono::steady_clock::time_point since, const double *rootLoad = nullptr,
+              const Checkpoint *from = nullptr);
+     // Drops what the last run left open, its limits and counters, so that
+     // the pool can run again on a sub-instance of the same size
+     void reset();
+     // Open nodes, incumbent and counters in the form of a checkpoint. With
+     // file set the nodes remember their tree index; a delta then only gets
+     // the nodes not in the file yet and refers to the others by that index
+     void snapshot(Checkpoint &cp, bool file = false, bool delta = false);
+     void push(Worker& wk, uint32_t id);
+     // Least lower bound of the open nodes and of those being expanded, the
+     // incumbent if it is lower
+     double lowerBound();
+     Incumbent& incumbent;
+     NodeArena arena;
+     PseudoCosts pseudo;
+     unique_ptr<TranspositionTable> table;   // null with --tt-mb=0
+     vector<unique_ptr<Worker>> workers;
+     // Estimated bytes of the open nodes: arena slots with their loads and
+     // frontier entries, and the warm starts
+     long long frontierBytes() const;
+     long long memBudget;
+     atomic<long long> peakBytes{0};
+     int checkpoints = 0;            // checkpoints written, full ones and deltas
+     int fullCheckpoints = 0;
+     long long checkpointBytes = 0;  // size of the file after the last one
+     const char *stopped = nullptr;  // limit that ended the search, null if the tree was exhausted
+
+private:
+#ifdef EC_USE_GUROBI
+     // Declared before the models so that they outlive them
+     vector<unique_ptr<GRBEnv>> envs;
+#endif
+     vector<unique_ptr<Relaxation>> relaxations;
+     atomic<long long> pending;
+     atomic<long long> expandedTotal{0};
+     atomic<bool> stop{false};
+     chrono::steady_clock::time_point start;   // of the time limit
+     mutex saveMutex;                // guards finished for the checkpoint thread
+     condition_variable saveCv;
+     bool finished = false;
+     uint32_t savedNodes = 0;        // tree nodes in the checkpoint file, 0: next one is full
+     vector<char> savedOpen;         // per tree node of the file, 1 if it is open there
+     void workerLoop(Worker& wk);
+     void saveCheckpoint();
+     void restore(const Checkpoint &cp);
+     bool steal(Worker& wk, OpenNode& p);
+     bool requeue(Worker& wk, uint32_t id);
+     void checkLimits();
 };
 
-void processNode(queue<node>& Q, node& p, double& min_upper, vector<vector<int>>& best_D);
-double calcProblem(node &p);
-double calcTargetVal(node &p);
+EngineStats runSearch(Incumbent &incumbent, chrono::steady_clock::time_point since);
+EngineStats runLNS(Incumbent &incumbent, chrono::steady_clock::time_point since);
+#ifdef EC_USE_GUROBI
+EngineStats solveMIQP(Incumbent &incumbent, chrono::steady_clock::time_point since);
+#endif
+void processNode(SearchPool& pool, Worker& wk, uint32_t id);
+void evaluateNode(SearchPool& pool, Worker& wk, uint32_t id);
+int selectBranch(SearchPool& pool, Worker& wk, const node& p);
+bool isMirrored(int i, const double *load, const vector<char> &blocked);
+int groupBounds(const Assignment &d, int &j, vector<char> &blocked);
+double calcProblem(Worker &wk, const PartialAssignment &part, const WarmStart *start,
+                   shared_ptr<const WarmStart> &warm, double cutoff, const vector<double> *&optionLower);
+double analyticBound(const PartialAssignment &part, vector<int> &servers);
+shared_ptr<const Exclusions> fixByReducedCost(Worker &wk, const vector<double> *optionLower, const vector<int> &free,
+                                              const shared_ptr<const Exclusions> &inherited, double upper);
+inline bool isExcluded(const Exclusions *ex, int j, int i);
+uint64_t queryKey(int j, int server);
+uint64_t stateKey(uint64_t hash, const double *load);
+double calcTargetVal(const Assignment &D_upper, const PartialAssignment &part, vector<double> &load);
+long long residentBytes();
+uint64_t instanceHash();
+void encodeCheckpoint(ostream &out, const Checkpoint &cp);
+bool decodeCheckpoint(istream &in, Checkpoint &cp, uint32_t base = 0);
+bool checkpointInRange(const Checkpoint &cp);
+bool writeCheckpoint(const string &path, const Checkpoint &cp, uint32_t base, const vector<uint32_t> &closed);
+bool readCheckpoint(const string &path, Checkpoint &cp);
+int listenOn(int port);
+int connectTo(const string &address);
+bool sendMessage(int fd, uint32_t type, const Checkpoint &cp);
+bool receiveMessage(int fd, uint32_t &type, Checkpoint &cp);
+EngineStats runCoordinator(Incumbent &incumbent, chrono::steady_clock::time_point since);
+void runWorker(int fd, const Checkpoint &welcome);
+void fixQuery(double *load, double &cost, double &fixed, int j, int server);
+int16_t roundRow(const double *row, int j, double *frac = nullptr);
+double greedyComplete(const PartialAssignment &part, Assignment &d, vector<double> &load);
+double localSearch(const PartialAssignment &part, Assignment &d, vector<double> &load);
+void runHeuristics(Incumbent &incumbent, const PartialAssignment &part, const Assignment *rounded,
+                   Assignment &d, vector<double> &load);
 double extract_bandwidth_from_line(const string& line);
 double test_bandwidth(const string& ip_address);
 vector<vector<int>> readMatrixFromFile(const string& filename, int rows, int cols);
 vector<int> readVectorFromFile(const string& filename, int size);
 void initializeParameters();
+void presolve();
+Assignment postsolve(const Assignment &core);
+void buildCoefficients();
+void parseOptions(int argc, char *argv[]);
 
 // EUs ESs
 int n, k; 
 
 // ip address for computing bandwidth
 string cloud_ip;
-vector<string> edge_servers_ip(k);
+vector<string> edge_servers_ip;
 // Bandwidth between the terminal and the edge server
 double r_nk_e;
 // Bandwidth between the terminal and the cloud
 double r_nk_c;
 
-// query executability vector
-vector<vector<int>> e; 
+// query executability vector
+vector<vector<int>> e; 
+
+// the amount of computation
+// the result size
+vector<int> c, w; 
+
+// the computational capability
+vector<int> F;
+
+// the tables above in the layout used by the solver
+Coefficients coef;
+
+// Reductions made before the search (see presolve): the original instance
+// and where the queries and servers of the reduced core come from
+struct Presolve
+{
+     int n, k;
+     vector<vector<int>> e;
+     vector<int> c, w, F;
+     vector<int> queries;   // original index of every core query
+     vector<int> servers;   // original index of every core server
+     int noServer = 0;      // queries fixed to the cloud: no executable server
+     int cheapCloud = 0;    // queries fixed to the cloud: cheaper than any server
+     double offset = 0.0;   // transfer cost of the fixed queries
+     uint64_t hash = 0;     // instanceHash() of the original instance
+};
+
+Presolve pre;
+
+int main(int argc,
+         char *argv[])
+{
+     // --time-limit and the execution time count from here: reading the
+     // input, the bandwidth test, presolve and the heuristics are included
+     auto start = chrono::steady_clock::now();
+     parseOptions(argc, argv);
+     initializeParameters();
+
+     // A worker takes the bandwidths of its coordinator, and a resumed search
+     // those its bounds were computed with
+     int coordinator = -1;
+     Checkpoint welcome;
+     if (!opts.connect.empty())
+     {
+          uint32_t type;
+          coordinator = connectTo(opts.connect);
+          if (coordinator < 0 || !receiveMessage(coordinator, type, welcome) || type != MSG_WELCOME)
+          {
+               cerr << "cannot reach coordinator " << opts.connect << endl;
+               return 1;
+          }
+          r_nk_e = welcome.r_nk_e;
+          r_nk_c = welcome.r_nk_c;
+     }
+     else if (opts.resume)
+     {
+          if (!readCheckpoint(opts.checkpoint, resumed))
+          {
+               cerr << "cannot read checkpoint " << opts.checkpoint << endl;
+               return 1;
+          }
+          r_nk_e = resumed.r_nk_e;
+          r_nk_c = resumed.r_nk_c;
+     }
+     else
+     {
+          r_nk_c = test_bandwidth(cloud_ip);
+          for(int i=0;i<k;i++) r_nk_e+=test_bandwidth(edge_servers_ip[i]);
+          r_nk_e=r_nk_e/k;
+     }
+     presolve();
+     pre.hash = instanceHash();
+     if (opts.resume && (resumed.instance != pre.hash || (int)resumed.D.size() != n || !checkpointInRange(resumed)))
+     {
+          cerr << "checkpoint " << opts.checkpoint << " is of another instance or presolve setting" << endl;
+          return 1;
+     }
+     if (coordinator >= 0 && welcome.instance != pre.hash)
+     {
+          cerr << "coordinator " << opts.connect << " solves another instance or presolve setting" << endl;
+          return 1;
+     }
+     buildCoefficients();
+     if (opts.presolve)
+     {
+          int grouped = 0;
+          for (int h : coef.groupHeads)
+               for (int j = h; j >= 0; j = coef.groupNext[j])
+                    grouped++;
+          cout << "presolve: " << pre.noServer << " queries without server and " << pre.cheapCloud
+               << " cheaper in the cloud fixed, " << pre.k - k << " servers dropped, " << grouped
+               << " queries in " << coef.groupHeads.size() << " groups; core " << n << " x " << k << endl;
+     }
+
+     if (coordinator >= 0)
+     {
+          runWorker(coordinator, welcome);
+          return 0;
+     }
+
+     Assignment all_cloud(n, CLOUD), none(n, FREE);
+     vector<double> no_load(k, 0.0), scratch;
+     vector<int> all_free(n);
+     iota(all_free.begin(), all_free.end(), 0);
+     PartialAssignment nothing_fixed = {&none, 0, no_load.data(), 0.0, &all_free};
+     Incumbent incumbent(calcTargetVal(all_cloud, nothing_fixed, scratch), all_cloud);
+     if (opts.heuristics)
+     {
+          Assignment greedy(n, CLOUD);
+          vector<double> greedy_load;
+          runHeuristics(incumbent, nothing_fixed, nullptr, greedy, greedy_load);
+     }
+     if (opts.resume)
+          incumbent.offer(calcTargetVal(resumed.D, nothing_fixed, scratch), resumed.D);
+     cout << "min_upper:" << incumbent.get() + pre.offset << endl;
+
+#ifdef EC_USE_GUROBI
+     // Both engines start from the heuristic incumbent
+     double rootValue = incumbent.get();
+     Assignment rootD = incumbent.assignment();
+#endif
+     EngineStats bb, miqp, lns;
+     try
+     {
+          if (opts.engine == ENGINE_LNS)
+               lns = runLNS(incumbent, start);
+          if (opts.engine == ENGINE_BB || opts.engine == ENGINE_BOTH)
+               bb = opts.serve > 0 ? runCoordinator(incumbent, start) : runSearch(incumbent, start);
+#ifdef EC_USE_GUROBI
+          if (opts.engine == ENGINE_MIQP || opts.engine == ENGINE_BOTH)
+          {
+               Incumbent own(rootValue, rootD);
+               miqp = solveMIQP(own, start);
+               incumbent.offer(own.get(), own.assignment());
+          }
+#endif
+     }
+#ifdef EC_USE_GUROBI
+     catch (GRBException e)
+     {
+          cout << "Error code = " << e.getErrorCode() << endl;
+          cout << e.getMessage() << endl;
+          return 1;
+     }
+#endif
+     catch (const exception &ex)
+     {
+          cout << ex.what() << endl;
+          return 1;
+     }
+     if (opts.engine == ENGINE_BOTH)
+     {
+          for (int t = 0; t < 2; t++)
+          {
+               const EngineStats &st = t == 0 ? bb : miqp;
+               cout << (t == 0 ? "bb:   " : "miqp: ") << st.status << ", value " << st.value + pre.offset
+                    << ", bound " << st.bound + pre.offset << ", nodes " << st.nodes << ", time " << st.ms << " ms"
+                    << endl;
+          }
+     }
+
+     double min_upper = incumbent.get() + pre.offset;
+     Assignment best_D = postsolve(incumbent.assignment());
+     n = pre.n;
+     k = pre.k;
+     e = pre.e;
+     c = pre.c;
+     w = pre.w;
+     F = pre.F;
+
+     // Rows of zeros are written as one string: n k numbers one at a time
+     // take seconds for 10^5 queries
+     string zeros;
+     for (int j = 0; j < k; j++)
+          zeros += "0 ";
+     cout << "bestD: " << endl;
+     for (int i = 0; i < n; i++)
+     {
+          int j = best_D[i];
+          if (j == CLOUD)
+               cout << zeros << '\n';
+          else
+               cout.write(zeros.data(), 2 * j) << "1 " << zeros.c_str() + 2 * (j + 1) << '\n';
+     }
+     vector<double> fm(k);
+     for (int j = 0; j < n; j++)
+     {
+          if (best_D[j] != CLOUD)
+               fm[best_D[j]] += e[j][best_D[j]] * sqrt(c[j]);
+     }
+     for (int i = 0; i < n; i++)
+     {
+          int j = best_D[i];
+          if (j == CLOUD)
+               cout << zeros << '\n';
+          else
+               cout.write(zeros.data(), 2 * j) << F[j] * sqrt(c[i]) / fm[j] << " " << zeros.c_str() + 2 * (j + 1)
+                                               << '\n';
+     }
+     cout << "bestTarget: " << min_upper << endl;
+     // Both bounds are valid with --engine=both, the higher one is kept
+     EngineStats result = opts.engine == ENGINE_MIQP ? miqp : opts.engine == ENGINE_LNS ? lns : bb;
+     if (opts.engine == ENGINE_BOTH && miqp.bound > result.bound)
+          result = miqp;
+     double bound = min(result.bound + pre.offset, min_upper);
+     const char *status = bound >= min_upper ? "optimal" : result.status;
+     cout << "status: " << status << ", bound: " << bound << ", gap: " << min_upper - bound << " ("
+          << 100.0 * (min_upper - bound) / max(fabs(min_upper), 1e-10) << "%)" << endl;
+
+     auto end = chrono::steady_clock::now();
+     auto duration = chrono::duration_cast<chrono::microseconds>(end - start)/1000;
+
+     cout << "Execution time: " << duration.count() << " ms" << endl;
+     
+     return 0;
+}
+
+// Current resident set size of the process, 0 if /proc is not available
+long long residentBytes()
+{
+     long long pages = 0, resident = 0;
+     ifstream statm("/proc/self/statm");
+     if (!(statm >> pages >> resident))
+          return 0;
+     return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Key of the original instance and of the options that shape the core, so
+// that a checkpoint is only resumed on the problem it was saved from
+uint64_t instanceHash()
+{
+     uint64_t h = mix64(((uint64_t)pre.n << 32) ^ (uint64_t)pre.k);
+     h = mix64(h ^ opts.presolve);
+     for (int j = 0; j < pre.n; j++)
+     {
+          h = mix64(h ^ ((uint64_t)(uint32_t)pre.c[j] << 32 | (uint32_t)pre.w[j]));
+          for (int i = 0; i < pre.k; i++)
+               h = mix64(h ^ (uint64_t)pre.e[j][i]);
+     }
+     for (int i = 0; i < pre.k; i++)
+          h = mix64(h ^ (uint64_t)pre.F[i]);
+     return h;
+}
+
+static const char CHECKPOINT_MAGIC[8] = {'E', 'C', 'C', 'K', 'P', 'T', '2', 0};
+
+template <class T>
+void putRaw(ostream &out, const vector<T> &v)
+{
+     uint64_t size = v.size();
+     out.write((const char *)&size, sizeof size);
+     out.write((const char *)v.data(), size * sizeof(T));
+}
+
+// Grows v as the data arrives, so that a corrupt size ends in a short read
+// rather than in allocating it
+template <class T>
+bool getRaw(istream &in, vector<T> &v)
+{
+     const size_t CHUNK = 1 << 20;
+     uint64_t size = 0;
+     if (!in.read((char *)&size, sizeof size) || size > (1ULL << 36) / sizeof(T))
+          return false;
+     v.clear();
+     while (v.size() < size)
+     {
+          size_t at = v.size(), len = min<uint64_t>(size - at, CHUNK);
+          v.resize(at + len);
+          if (!in.read((char *)&v[at], len * sizeof(T)))
+               return false;
+     }
+     return true;
+}
+
+// Body of a checkpoint file, also the payload of the distributed messages
+void encodeCheckpoint(ostream &out, const Checkpoint &cp)
+{
+     out.write((const char *)&cp.instance, sizeof cp.instance);
+     out.write((const char *)&cp.r_nk_e, sizeof cp.r_nk_e);
+     out.write((const char *)&cp.r_nk_c, sizeof cp.r_nk_c);
+     out.write((const char *)&cp.expanded, sizeof cp.expanded);
+     putRaw(out, cp.D);
+     putRaw(out, cp.parent);
+     putRaw(out, cp.query);
+     putRaw(out, cp.server);
+     putRaw(out, cp.open);
+     putRaw(out, cp.lower);
+}
+
+// The tree of a delta continues one of base nodes, see writeCheckpoint
+bool decodeCheckpoint(istream &in, Checkpoint &cp, uint32_t base)
+{
+     in.read((char *)&cp.instance, sizeof cp.instance);
+     in.read((char *)&cp.r_nk_e, sizeof cp.r_nk_e);
+     in.read((char *)&cp.r_nk_c, sizeof cp.r_nk_c);
+     in.read((char *)&cp.expanded, sizeof cp.expanded);
+     if (!in || !getRaw(in, cp.D) || !getRaw(in, cp.parent) || !getRaw(in, cp.query) || !getRaw(in, cp.server)
+         || !getRaw(in, cp.open) || !getRaw(in, cp.lower))
+          return false;
+     size_t nodes = cp.parent.size();
+     if (cp.query.size() != nodes || cp.server.size() != nodes || cp.lower.size() != cp.open.size())
+          return false;
+     for (size_t t = 0; t < nodes; t++)
+          if (cp.parent[t] != NodeArena::NONE ? cp.parent[t] >= base + t : base + t != 0)
+               return false;
+     for (uint32_t t : cp.open)
+          if (t >= base + nodes)
+               return false;
+     return checkpointInRange(cp);
+}
+
+// Whether the decisions and the incumbent of cp are queries and servers of
+// the instance: a checkpoint read before presolve is checked again on the
+// core, a message is checked on it when it arrives
+bool checkpointInRange(const Checkpoint &cp)
+{
+     for (size_t t = 0; t < cp.parent.size(); t++)
+          if (cp.parent[t] != NodeArena::NONE
+              && (cp.query[t] < 0 || cp.query[t] >= n || cp.server[t] < CLOUD || cp.server[t] >= k))
+               return false;
+     for (int16_t i : cp.D)
+          if (i < CLOUD || i >= k)
+               return false;
+     return true;
+}
+
+// A checkpoint file is CHECKPOINT_MAGIC followed by records: the record's
+// size, the number of tree nodes before it (base), the open nodes of the
+// earlier records it closes and a checkpoint body, whose tree continues
+// theirs and whose open nodes are added to theirs. The first record, with
+// base 0, is written to path.tmp and renamed over path, so that a job
+// killed while writing leaves the previous file intact; the others are
+// appended, and one cut short is ignored when the file is read.
+bool writeCheckpoint(const string &path, const Checkpoint &cp, uint32_t base, const vector<uint32_t> &closed)
+{
+     ostringstream record;
+     record.write((const char *)&base, sizeof base);
+     putRaw(record, closed);
+     encodeCheckpoint(record, cp);
+     string body = record.str();
+     uint64_t size = body.size();
+     string target = base ? path : path + ".tmp";
+     {
+          ofstream out(target, ios::binary | (base ? ios::app : ios::trunc));
+          if (!base)
+               out.write(CHECKPOINT_MAGIC, sizeof CHECKPOINT_MAGIC);
+          out.write((const char *)&size, sizeof size);
+          out.write(body.data(), size);
+          if (!out.flush())
+               return false;
+     }
+     return base || rename(target.c_str(), path.c_str()) == 0;
+}
+
+bool readCheckpoint(const string &path, Checkpoint &cp)
+{
+     ifstream in(path, ios::binary);
+     char magic[sizeof CHECKPOINT_MAGIC];
+     if (!in.read(magic, sizeof magic) || !equal(magic, magic + sizeof magic, CHECKPOINT_MAGIC))
+          return false;
+     vector<char> isOpen;
+     vector<double> lower;
+     bool any = false;
+     uint64_t size = 0;
+     string body;
+     while (in.read((char *)&size, sizeof size) && size <= (1ULL << 36))
+     {
+          body.resize(size);
+          if (!in.read(&body[0], size))
+               break;
+          istringstream record(body);
+          uint32_t base = 0;
+          vector<uint32_t> closed;
+          Checkpoint delta;
+          if (!record.read((char *)&base, sizeof base) || base != cp.parent.size() || !getRaw(record, closed)
+              || !decodeCheckpoint(record, delta, base) || (any && delta.instance != cp.instance))
+               return false;
+          cp.parent.insert(cp.parent.end(), delta.parent.begin(), delta.parent.end());
+          cp.query.insert(cp.query.end(), delta.query.begin(), delta.query.end());
+          cp.server.insert(cp.server.end(), delta.server.begin(), delta.server.end());
+          isOpen.resize(cp.parent.size(), 0);
+          lower.resize(cp.parent.size());
+          for (uint32_t t : closed)
+          {
+               if (t >= base || !isOpen[t])
+                    return false;
+               isOpen[t] = 0;
+          }
+          for (size_t t = 0; t < delta.open.size(); t++)
+          {
+               isOpen[delta.open[t]] = 1;
+               lower[delta.open[t]] = delta.lower[t];
+          }
+          cp.instance = delta.instance;
+          cp.r_nk_e = delta.r_nk_e;
+          cp.r_nk_c = delta.r_nk_c;
+          cp.D = move(delta.D);
+          cp.expanded = delta.expanded;
+          any = true;
+     }
+     for (uint32_t t = 0; t < isOpen.size(); t++)
+          if (isOpen[t])
+          {
+               cp.open.push_back(t);
+               cp.lower.push_back(lower[t]);
+          }
+     return any;
+}
+
+// Runs the branch-and-bound from incumbent until the limits, the time one
+// counted from since, and prints its statistics
+EngineStats runSearch(Incumbent &incumbent, chrono::steady_clock::time_point since)
+{
+     auto start = chrono::high_resolution_clock::now();
+     SearchPool pool(opts.threads, incumbent);
+     pool.run(since, nullptr, opts.resume ? &resumed : nullptr);
+     long long expanded = 0, pruned = 0, stolen = 0, symmetric = 0, solved = 0, skipped = 0;
+     long long tierPruned[3] = {0, 0, 0}, transposed = 0, dives = 0, dived = 0, rcFixed = 0, rcSkipped = 0;
+     double iterations = 0.0, lagrangeIterations = 0.0;
+     for (auto &w : pool.workers)
+     {
+          expanded += w->expanded;
+          pruned += w->pruned;
+          stolen += w->stolen;
+          symmetric += w->symmetric;
+          solved += w->solved;
+          skipped += w->skipped;
+          for (int t = 0; t < 3; t++)
+               tierPruned[t] += w->tierPruned[t];
+          transposed += w->transposed;
+          dives += w->dives;
+          dived += w->dived;
+          rcFixed += w->rcFixed;
+          rcSkipped += w->rcSkipped;
+          if (w->relax)
+               iterations += w->relax->iterations;
+          if (w->lagrangian)
+               lagrangeIterations += w->lagrangian->iterations;
+     }
+     cout << "threads: " << opts.threads << ", nodes expanded: " << expanded
+          << ", stale nodes dropped: " << pruned << ", nodes stolen: " << stolen << endl;
+     cout << "relaxations solved: " << solved << ", lazy nodes dropped unsolved: " << skipped << endl;
+     if (opts.cascade)
+          cout << "pruned by fixed part: " << tierPruned[0] << ", by analytic bound: " << tierPruned[1]
+               << ", by relaxation: " << tierPruned[2] << endl;
+     if (pool.table)
+          cout << "transpositions pruned: " << transposed << " (table " << pool.table->bytes() / (1024 * 1024)
+               << " MiB)" << endl;
+     if (opts.reducedCost)
+          cout << "options fixed by reduced costs: " << rcFixed << ", children skipped by them: " << rcSkipped << endl;
+     cout << "relaxation iterations: " << iterations << " (" << simdName << " kernels)" << endl;
+     if (opts.bound != BOUND_QP)
+          cout << "subgradient iterations: " << lagrangeIterations << endl;
+     if (opts.symmetry)
+          cout << "server classes: " << set<int>(coef.serverClass.begin(), coef.serverClass.end()).size()
+               << ", mirrored children skipped: " << symmetric << endl;
+     struct rusage usage;
+     getrusage(RUSAGE_SELF, &usage);
+     cout << "peak live nodes: " << pool.arena.peak() << ", peak open-node memory: " << (pool.peakBytes >> 20)
+          << " MiB of " << (pool.memBudget >> 20) << " MiB, resident: " << (residentBytes() >> 20)
+          << " MiB (peak " << usage.ru_maxrss / 1024 << " MiB)" << endl;
+     if (dives)
+          cout << "depth-first dives over the budget: " << dives << ", nodes expanded in them: " << dived << endl;
+     if (opts.resume)
+          cout << "resumed " << resumed.open.size() << " open nodes after " << resumed.expanded
+               << " nodes expanded" << endl;
+     if (pool.checkpoints)
+          cout << "checkpoints written: " << pool.checkpoints << " (" << pool.fullCheckpoints << " full), "
+               << opts.checkpoint << ": " << pool.checkpointBytes / 1024 << " KiB" << endl;
+     EngineStats st;
+     st.value = incumbent.get();
+     st.bound = st.value;
+     if (pool.stopped)
+     {
+          // The open nodes left behind still bound the optimum
+          st.bound = pool.lowerBound();
+          st.status = pool.stopped;
+     }
+     st.nodes = expanded;
+     st.ms = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count();
+     return st;
+}
+
+// Takes the instance tables and the options out of the globals for the
+// sub-instances of the LNS and puts them back when it goes out of scope,
+// also when a sub-search throws
+struct InstanceScope
+{
+     int n;
+     vector<vector<int>> e;
+     vector<int> c, w;
+     Coefficients coef;
+     SolverOptions opts;
+
+     InstanceScope() : n(::n), coef(move(::coef)), opts(::opts)
+     {
+          e.swap(::e);
+          c.swap(::c);
+          w.swap(::w);
+     }
+     ~InstanceScope()
+     {
+          ::n = n;
+          ::e.swap(e);
+          ::c.swap(c);
+          ::w.swap(w);
+          ::coef = move(coef);
+          ::opts = opts;
+     }
+};
+
+// Large neighborhood search, single-threaded: starting from the incumbent,
+// a neighborhood of queries is freed (destroy) and reassigned by the
+// branch-and-bound with all others fixed (repair); improvements are kept. A
+// neighborhood becomes a sub-instance of its queries, whose root carries the
+// loads of the other queries. Loads and the queries on every server are
+// updated in place, so an iteration costs O(size k) plus its search, whatever
+// n is. The kind of neighborhood with the most improvements per second of
+// late is chosen, another one at random every fourth time. Neighborhoods
+// start at lnsSize queries and double after STALL of them in a row without
+// improvement, up to 8 lnsSize. The search ends at the time limit counted
+// from since, or a second after it began if there is none.
+EngineStats runLNS(Incumbent &incumbent, chrono::steady_clock::time_point since)
+{
+     auto start = chrono::steady_clock::now();
+     // Without a time limit the search gets a second of its own
+     auto from = opts.timeLimit > 0.0 ? since : start;
+     double limit = opts.timeLimit > 0.0 ? opts.timeLimit : 1.0;
+     const int METHODS = 4, STALL = 100;
+     int smallest = min(opts.lnsSize, n), largest = min(8 * opts.lnsSize, n), m = smallest, used = m;
+
+     EngineStats st;
+     st.status = "heuristic";
+     {
+          Assignment none(n, FREE);
+          vector<double> noLoad(k, 0.0);
+          vector<int> allFree(n), servers(k);
+          iota(allFree.begin(), allFree.end(), 0);
+          iota(servers.begin(), servers.end(), 0);
+          PartialAssignment root = {&none, 0, noLoad.data(), 0.0, &allFree};
+          st.bound = analyticBound(root, servers);
+     }
+
+     // Current solution: queries on server i are members[i + 1], the cloud's members[0]
+     Assignment d = incumbent.assignment();
+     vector<double> load(k, 0.0);
+     vector<vector<int>> members(k + 1);
+     vector<int> pos(n);
+     for (int j = 0; j < n; j++)
+     {
+          if (d[j] != CLOUD)
+               load[d[j]] += coef.sqrtC[j];
+          pos[j] = members[d[j] + 1].size();
+          members[d[j] + 1].push_back(j);
+     }
+
+     const char *names[METHODS] = {"random", "server", "cost", "loaded"};
+     long long tried[METHODS] = {0, 0, 0, 0}, improved[METHODS] = {0, 0, 0, 0};
+     // Improvements and seconds of every kind, decayed by its use
+     double hits[METHODS] = {0.0, 0.0, 0.0, 0.0}, spent[METHODS] = {0.0, 0.0, 0.0, 0.0};
+     long long iterations = 0;
+     double gained = 0.0;
+     {
+          // The sub-instances replace the instance tables until the end of the block
+          InstanceScope full;
+          opts.threads = 1;
+          opts.backend = BACKEND_NATIVE;   // a Gurobi environment per neighborhood costs more than its search
+          opts.ttMB = 0;
+          opts.checkpoint.clear();
+          opts.resume = false;
+          opts.timeLimit = limit;   // also stops the search of the last neighborhood
+          opts.nodeLimit = full.opts.lnsNodes;
+          opts.gap = opts.absGap = 0.0;
+          opts.verbose = false;
+
+          mt19937 rng(1);
+          auto random = [&](size_t bound) { return (int)(rng() % bound); };
+          // Saving from taking query j off its current option
+          auto saving = [&](int j) {
+               int s = d[j];
+               double a = full.coef.sqrtC[j];
+               return s == CLOUD ? full.coef.costCloud[j]
+                                 : (2.0 * load[s] - a) * a * full.coef.invF[s] + full.coef.costEdge[j];
+          };
+          vector<char> inHood(full.n, 0);
+          vector<int> hood, sample, order(k);
+          // The instance tables and the coefficients are sized for the
+          // current size, the pools kept for every size used
+          Assignment cur, none;
+          vector<int> allFree;
+          vector<double> base(k), scratch;
+          Incumbent sub(0.0, cur);
+          map<int, unique_ptr<SearchPool>> pools;
+          auto take = [&](int j) {
+               if (inHood[j] || (int)hood.size() >= m)
+                    return;
+               inHood[j] = 1;
+               hood.push_back(j);
+          };
+          auto fromServer = [&](int s, int count) {
+               const vector<int> &on = members[s + 1];
+               for (int t = 0; t < count && !on.empty(); t++)
+                    take(on[random(on.size())]);
+          };
+
+          int failures = 0, sized = 0;
+          while (m > 0 && chrono::duration<double>(chrono::steady_clock::now() - from).count() < limit)
+          {
+               if (failures >= STALL)
+               {
+                    m = min(2 * m, largest);
+                    used = max(used, m);
+                    failures = 0;
+               }
+               if (sized != m)
+               {
+                    sized = n = m;
+                    e.resize(m);
+                    c.resize(m);
+                    w.resize(m);
+                    cur.resize(m);
+                    none.assign(m, FREE);
+                    allFree.resize(m);
+                    iota(allFree.begin(), allFree.end(), 0);
+               }
+
+               int method = random(METHODS);
+               if (random(4) != 0)
+                    for (int t = 0; t < METHODS; t++)
+                         if ((hits[t] + 1.0) / (spent[t] + 0.01) > (hits[method] + 1.0) / (spent[method] + 0.01))
+                              method = t;
+               iterations++;
+               auto began = chrono::steady_clock::now();
+               hood.clear();
+               if (method == 1)
+               {
+                    // Queries on a random server and queries that could move there
+                    int s = random(k);
+                    fromServer(s, m / 2);
+                    for (int t = 0; t < 8 * m && (int)hood.size() < m; t++)
+                    {
+                         int j = random(full.n);
+                         if (full.e[j][s])
+                              take(j);
+                    }
+               }
+               else if (method == 2)
+               {
+                    // The queries that save the most when taken out, of a random sample
+                    sample.clear();
+                    for (int t = 0; t < 4 * m; t++)
+                         sample.push_back(random(full.n));
+                    sort(sample.begin(), sample.end(), [&](int j1, int j2) { return saving(j1) > saving(j2); });
+                    for (int j : sample)
+                         take(j);
+               }
+               else if (method == 3)
+               {
+                    // Queries on one of the servers whose next unit of load
+                    // costs the most, and on the cheapest ones they could
+                    // move to, which may pass theirs on to a third
+                    iota(order.begin(), order.end(), 0);
+                    sort(order.begin(), order.end(), [&](int i1, int i2) {
+                         return load[i1] * full.coef.invF[i1] > load[i2] * full.coef.invF[i2];
+                    });
+                    int s = order[random(min(k, 4))];
+                    fromServer(s, m / 2);
+                    size_t moving = hood.size();
+                    for (int r = k - 1; r >= 0 && (int)hood.size() < m; r--)
+                    {
+                         int i = order[r];
+                         bool reachable = false;
+                         for (size_t t = 0; t < moving && !reachable; t++)
+                              reachable = full.e[hood[t]][i];
+                         if (reachable && i != s)
+                              fromServer(i, max(1, m / 8));
+                    }
+               }
+               while ((int)hood.size() < m)
+                    take(random(full.n));
+               for (int j : hood)
+                    inHood[j] = 0;
+               tried[method]++;
+
+               // Sub-instance of the neighborhood
+               base = load;
+               for (int j : hood)
+                    if (d[j] != CLOUD)
+                         base[d[j]] -= full.coef.sqrtC[j];
+               for (int t = 0; t < m; t++)
+               {
+                    e[t] = full.e[hood[t]];
+                    c[t] = full.c[hood[t]];
+                    w[t] = full.w[hood[t]];
+                    cur[t] = d[hood[t]];
+               }
+               buildCoefficients();
+               PartialAssignment root = {&none, 0, base.data(), 0.0, &allFree};
+               double before = calcTargetVal(cur, root, scratch);
+               sub.reset(before, cur);
+               unique_ptr<SearchPool> &pool = pools[m];
+               if (pool)
+                    pool->reset();
+               else
+                    pool.reset(new SearchPool(1, sub));
+               pool->run(from, base.data());
+               st.nodes += pool->workers[0]->expanded;
+               bool better = sub.get() < before - 1e-9 * max(1.0, fabs(before));
+               double took = chrono::duration<double>(chrono::steady_clock::now() - began).count();
+               hits[method] = 0.95 * hits[method] + better;
+               spent[method] = 0.95 * spent[method] + took;
+               if (!better)
+               {
+                    failures++;
+                    continue;
+               }
+
+               improved[method]++;
+               gained += before - sub.get();
+               failures = 0;
+               Assignment moved = sub.assignment();
+               for (int t = 0; t < m; t++)
+               {
+                    int j = hood[t], from = d[j], to = moved[t];
+                    if (from == to)
+                         continue;
+                    vector<int> &out = members[from + 1];
+                    pos[out.back()] = pos[j];
+                    out[pos[j]] = out.back();
+                    out.pop_back();
+                    pos[j] = members[to + 1].size();
+                    members[to + 1].push_back(j);
+                    if (from != CLOUD)
+                         load[from] -= full.coef.sqrtC[j];
+                    if (to != CLOUD)
+                         load[to] += full.coef.sqrtC[j];
+                    d[j] = to;
+               }
+          }
+     }
+
+     Assignment none(n, FREE);
+     vector<double> noLoad(k, 0.0), scratch;
+     vector<int> allFree(n);
+     iota(allFree.begin(), allFree.end(), 0);
+     PartialAssignment root = {&none, 0, noLoad.data(), 0.0, &allFree};
+     incumbent.offer(calcTargetVal(d, root, scratch), d);
+
+     auto now = chrono::steady_clock::now();
+     st.value = incumbent.get();
+     st.ms = chrono::duration_cast<chrono::milliseconds>(now - start).count();
+     cout << "lns: " << iterations << " neighborhoods of " << smallest << " to " << used << " queries, improved";
+     for (int t = 0; t < METHODS; t++)
+          cout << (t ? ", " : " ") << names[t] << " " << improved[t] << "/" << tried[t];
+     cout << " by " << gained << "; sub-search nodes: " << st.nodes << "; " << st.ms << " ms from "
+          << chrono::duration_cast<chrono::milliseconds>(start - since).count() << " to "
+          << chrono::duration_cast<chrono::milliseconds>(now - since).count() << " ms after the start" << endl;
+     return st;
+}
+
+int listenOn(int port)
+{
+     int fd = socket(AF_INET6, SOCK_STREAM, 0);
+     if (fd < 0)
+          return -1;
+     int on = 1, off = 0;
+     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+     setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof off);
+     sockaddr_in6 addr = {};
+     addr.sin6_family = AF_INET6;
+     addr.sin6_addr = in6addr_any;
+     addr.sin6_port = htons(port);
+     if (bind(fd, (sockaddr *)&addr, sizeof addr) < 0 || listen(fd, 64) < 0)
+     {
+          close(fd);
+          return -1;
+     }
+     return fd;
+}
+
+int connectTo(const string &address)
+{
+     size_t colon = address.rfind(':');
+     if (colon == string::npos)
+          return -1;
+     addrinfo hints = {}, *found = nullptr;
+     hints.ai_socktype = SOCK_STREAM;
+     if (getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &found) != 0)
+          return -1;
+     int fd = -1;
+     for (addrinfo *a = found; a && fd < 0; a = a->ai_next)
+     {
+          fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+          if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0)
+          {
+               close(fd);
+               fd = -1;
+          }
+     }
+     freeaddrinfo(found);
+     int on = 1;
+     if (fd >= 0)
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+     return fd;
+}
+
+// Frame: type, payload length, encodeCheckpoint of cp
+bool sendMessage(int fd, uint32_t type, const Checkpoint &cp)
+{
+     ostringstream body;
+     encodeCheckpoint(body, cp);
+     string payload = body.str();
+     uint64_t size = payload.size();
+     string frame((const char *)&type, sizeof type);
+     frame.append((const char *)&size, sizeof size);
+     frame += payload;
+     for (size_t done = 0; done < frame.size();)
+     {
+          ssize_t sent = send(fd, frame.data() + done, frame.size() - done, MSG_NOSIGNAL);
+          if (sent <= 0)
+               return false;
+          done += sent;
+     }
+     return true;
+}
+
+bool receiveMessage(int fd, uint32_t &type, Checkpoint &cp)
+{
+     auto readAll = [fd](char *buf, size_t len) {
+          while (len > 0)
+          {
+               ssize_t got = recv(fd, buf, len, 0);
+               if (got <= 0)
+                    return false;
+               buf += got;
+               len -= got;
+          }
+          return true;
+     };
+     uint64_t size = 0;
+     if (!readAll((char *)&type, sizeof type) || !readAll((char *)&size, sizeof size) || size > (1ULL << 30))
+          return false;
+     string payload(size, '\0');
+     if (!readAll(&payload[0], size))
+          return false;
+     istringstream body(payload);
+     cp = Checkpoint();
+     return decodeCheckpoint(body, cp);
+}
+
+// Open subtree of the coordinator: its decisions from the root
+struct Subtree
+{
+     double lower;
+     vector<int32_t> query;
+     vector<int16_t> server;
+};
+
+// Same order as NodeCompare: lowest bound first, deeper on ties
+struct SubtreeCompare
+{
+     bool operator()(const Subtree &a, const Subtree &b) const
+     {
+          if (a.lower != b.lower)
+               return a.lower > b.lower;
+          return a.query.size() < b.query.size();
+     }
+};
+
+EngineStats runCoordinator(Incumbent &incumbent, chrono::steady_clock::time_point since)
+{
+     auto start = chrono::steady_clock::now();
+     int listener = listenOn(opts.serve);
+     if (listener < 0)
+          throw runtime_error("cannot listen on port " + to_string(opts.serve));
+     cout << "coordinator listening on port " << opts.serve << endl;
+
+     Assignment none(n, FREE);
+     vector<double> noLoad(k, 0.0), scratch;
+     vector<int> allFree(n);
+     iota(allFree.begin(), allFree.end(), 0);
+     PartialAssignment root = {&none, 0, noLoad.data(), 0.0, &allFree};
+
+     // A worker is ready while it waits for work, busy while it has some
+     struct Peer { int fd; bool ready, busy; vector<Subtree> work; };
+     vector<Peer> peers;
+     priority_queue<Subtree, vector<Subtree>, SubtreeCompare> open;
+     open.push({0.0, {}, {}});
+     Checkpoint msg;
+     msg.instance = pre.hash;
+     msg.r_nk_e = r_nk_e;
+     msg.r_nk_c = r_nk_c;
+     long long nodes = 0, assigned = 0, returned = 0, workers = 0;
+     const char *stopped = nullptr;
+     auto lowerBound = [&]() {
+          double lo = incumbent.get();
+          if (!open.empty())
+               lo = min(lo, open.top().lower);
+          for (const Peer &p : peers)
+               if (p.busy)
+                    lo = min(lo, p.work.front().lower);
+          return lo;
+     };
+
+     while (true)
+     {
+          while (!open.empty() && open.top().lower > incumbent.get())
+               open.pop();
+          for (Peer &p : peers)
+          {
+               if (!p.ready || open.empty())
+                    continue;
+               // The best subtrees, a share that leaves work for the others,
+               // as paths from the root with shared prefixes sent once
+               size_t batch = max<size_t>(1, open.size() / (2 * peers.size()));
+               map<tuple<uint32_t, int32_t, int16_t>, uint32_t> index;
+               msg.D = incumbent.assignment();
+               msg.parent.assign(1, (uint32_t)NodeArena::NONE);
+               msg.query.assign(1, -1);
+               msg.server.assign(1, CLOUD);
+               msg.open.clear();
+               msg.lower.clear();
+               p.work.clear();
+               for (size_t b = 0; b < batch && !open.empty(); b++)
+               {
+                    const Subtree &t = open.top();
+                    uint32_t at = 0;
+                    for (size_t d = 0; d < t.query.size(); d++)
+                    {
+                         auto it = index.emplace(make_tuple(at, t.query[d], t.server[d]), msg.parent.size()).first;
+                         if (it->second == msg.parent.size())
+                         {
+                              msg.parent.push_back(at);
+                              msg.query.push_back(t.query[d]);
+                              msg.server.push_back(t.server[d]);
+                         }
+                         at = it->second;
+                    }
+                    msg.open.push_back(at);
+                    msg.lower.push_back(t.lower);
+                    p.work.push_back(t);
+                    open.pop();
+               }
+               p.ready = false;
+               p.busy = true;
+               assigned += p.work.size();
+               // A failed send shows up as a hang-up below
+               sendMessage(p.fd, MSG_WORK, msg);
+          }
+          bool busy = false;
+          for (const Peer &p : peers)
+               busy |= p.busy;
+          if (open.empty() && !busy)
+               break;
+
+          double seconds = chrono::duration<double>(chrono::steady_clock::now() - since).count();
+          double upper = incumbent.get() + pre.offset, gap = upper - (lowerBound() + pre.offset);
+          if (opts.timeLimit > 0.0 && seconds >= opts.timeLimit)
+               stopped = "time limit";
+          else if (opts.nodeLimit > 0 && nodes >= opts.nodeLimit)
+               stopped = "node limit";
+          else if ((opts.gap > 0.0 || opts.absGap > 0.0)
+                   && (gap <= opts.absGap || gap <= opts.gap * max(fabs(upper), 1e-10)))
+               stopped = "gap reached";
+          if (stopped)
+               break;
+
+          vector<pollfd> fds(1, {listener, POLLIN, 0});
+          for (const Peer &p : peers)
+               fds.push_back({p.fd, POLLIN, 0});
+          if (poll(fds.data(), fds.size(), 100) <= 0)
+               continue;
+          if (fds[0].revents & POLLIN)
+          {
+               int fd = accept(listener, nullptr, nullptr);
+               msg.D = incumbent.assignment();
+               msg.parent.clear();
+               msg.query.clear();
+               msg.server.clear();
+               msg.open.clear();
+               msg.lower.clear();
+               if (fd >= 0 && sendMessage(fd, MSG_WELCOME, msg))
+               {
+                    peers.push_back({fd, false, false, {}});
+                    workers++;
+               }
+               else if (fd >= 0)
+                    close(fd);
+          }
+          for (size_t i = fds.size() - 1; i > 0; i--)
+          {
+               if (!fds[i].revents)
+                    continue;
+               Peer &p = peers[i - 1];
+               uint32_t type;
+               Checkpoint result;
+               if (!(fds[i].revents & POLLIN) || !receiveMessage(p.fd, type, result) || type != MSG_RESULT)
+               {
+                    // Lost worker: its subtrees go back to the others
+                    if (p.busy)
+                         for (Subtree &t : p.work)
+                              open.push(move(t));
+                    close(p.fd);
+                    peers.erase(peers.begin() + (i - 1));
+                    continue;
+               }
+               if ((int)result.D.size() == n)
+                    incumbent.offer(calcTargetVal(result.D, root, scratch), result.D);
+               nodes += result.expanded;
+               for (size_t t = 0; t < result.open.size(); t++)
+               {
+                    if (result.lower[t] > incumbent.get())
+                         continue;
+                    Subtree sub;
+                    sub.lower = result.lower[t];
+                    for (uint32_t at = result.open[t]; result.parent[at] != NodeArena::NONE; at = result.parent[at])
+                    {
+                         sub.query.push_back(result.query[at]);
+                         sub.server.push_back(result.server[at]);
+                    }
+                    reverse(sub.query.begin(), sub.query.end());
+                    reverse(sub.server.begin(), sub.server.end());
+                    open.push(move(sub));
+                    returned++;
+               }
+               p.busy = false;
+               p.ready = true;
+          }
+     }
+
+     EngineStats st;
+     st.value = incumbent.get();
+     st.bound = stopped ? lowerBound() : st.value;
+     st.status = stopped ? stopped : "optimal";
+     for (Peer &p : peers)
+     {
+          if (p.ready)
+               sendMessage(p.fd, MSG_DONE, msg);
+          close(p.fd);
+     }
+     close(listener);
+     cout << "distributed: " << workers << " workers, subtrees assigned: " << assigned
+          << ", open nodes returned: " << returned << ", nodes expanded: " << nodes << endl;
+     st.nodes = nodes;
+     st.ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+     return st;
+}
+
+// Searches the subtrees the coordinator sends until it has none left. The
+// limits belong to the coordinator; a worker's only limit is --dist-nodes.
+void runWorker(int fd, const Checkpoint &welcome)
+{
+     opts.checkpoint.clear();
+     opts.resume = false;
+     opts.timeLimit = 0.0;
+     opts.gap = opts.absGap = 0.0;
+     opts.nodeLimit = opts.distNodes;
+
+     Assignment none(n, FREE);
+     vector<double> noLoad(k, 0.0), scratch;
+     vector<int> allFree(n);
+     iota(allFree.begin(), allFree.end(), 0);
+     PartialAssignment root = {&none, 0, noLoad.data(), 0.0, &allFree};
+
+     // One table for all subtrees: a state seen in an earlier one was either
+     // searched or returned open, so it still need not be searched twice
+     unique_ptr<TranspositionTable> table;
+     if (opts.ttMB > 0)
+          table.reset(new TranspositionTable((size_t)opts.ttMB << 20));
+     Checkpoint result, work;
+     result.instance = welcome.instance;
+     long long batches = 0, nodes = 0;
+     uint32_t type;
+     while (sendMessage(fd, MSG_RESULT, result) && receiveMessage(fd, type, work) && type == MSG_WORK
+            && (int)work.D.size() == n)
+     {
+          Incumbent incumbent(calcTargetVal(work.D, root, scratch), work.D);
+          SearchPool pool(opts.threads, incumbent, move(table));
+          pool.run(chrono::steady_clock::now(), nullptr, &work);
+          result = Checkpoint();
+          pool.snapshot(result);
+          table = move(pool.table);
+          batches++;
+          nodes += result.expanded;
+     }
+     close(fd);
+     cout << "worker: " << batches << " batches of subtrees, nodes expanded: " << nodes << endl;
+}
+
+SearchPool::SearchPool(int threads, Incumbent& incumbent, unique_ptr<TranspositionTable> shared)
+    : incumbent(incumbent), arena(k), pseudo(n), table(move(shared)), pending(0)
+{
+     if (!table && opts.ttMB > 0)
+          table.reset(new TranspositionTable((size_t)opts.ttMB << 20));
+     memBudget = opts.memMB > 0 ? opts.memMB << 20 : (long long)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+     for (int i = 0; i < threads; i++)
+     {
+          Relaxation *relax = nullptr, *lagrangian = nullptr;
+          if (opts.bound != BOUND_LAGRANGIAN)
+          {
+               if (opts.backend == BACKEND_NATIVE)
+                    relaxations.emplace_back(new NativeRelaxation());
+#ifdef EC_USE_GUROBI
+               else
+               {
+                    // Workers solve their QPs concurrently, so each env gets one thread
+                    unique_ptr<GRBEnv> env(new GRBEnv(true));
+                    env->set(GRB_IntParam_OutputFlag, opts.verbose ? 1 : 0);
+                    if (threads > 1)
+                         env->set(GRB_IntParam_Threads, 1);
+                    env->start();
+                    relaxations.emplace_back(new GurobiRelaxation(*env));
+                    envs.push_back(move(env));
+               }
+#endif
+               relax = relaxations.back().get();
+          }
+          if (opts.bound != BOUND_QP)
+          {
+               relaxations.emplace_back(new LagrangianBound());
+               lagrangian = relaxations.back().get();
+          }
+          workers.emplace_back(new Worker(i, relax, lagrangian));
+          workers.back()->d.assign(n, CLOUD);
+          workers.back()->d_upper.assign(n, CLOUD);
+          workers.back()->heur.assign(n, CLOUD);
+          workers.back()->load.assign(k, 0.0);
+          workers.back()->blocked.assign(k, 0);
+          workers.back()->servers.resize(k);
+          iota(workers.back()->servers.begin(), workers.back()->servers.end(), 0);
+     }
+}
+
+void SearchPool::reset()
+{
+     arena.clear();
+     pseudo.clear();
+     if (table)
+          table->clear();
+     for (auto &w : workers)
+     {
+          w->Q.clear();
+          w->dive.clear();
+          w->diving = false;
+          // The heuristics are spaced by expanded
+          w->expanded = w->pruned = w->stolen = w->symmetric = w->solved = w->skipped = 0;
+          fill(w->tierPruned, w->tierPruned + 3, 0);
+          w->transposed = w->dives = w->dived = w->rcFixed = w->rcSkipped = 0;
+     }
+     pending.store(0, memory_order_relaxed);
+     expandedTotal.store(0, memory_order_relaxed);
+     stop.store(false, memory_order_relaxed);
+     stopped = nullptr;
+     finished = false;
+     savedNodes = 0;
+}
+
+long long SearchPool::frontierBytes() const
+{
+     return (long long)arena.live() * (sizeof(node) + sizeof(OpenNode) + k * sizeof(double))
+            + warmStartBytes.load(memory_order_relaxed);
+}
+
+void SearchPool::push(Worker& wk, uint32_t id)
+{
+     node &p = arena[id];
+     pending.fetch_add(1, memory_order_relaxed);
+     lock_guard<mutex> lock(wk.m);
+     if (wk.diving)
+          wk.dive.push_back({p.lower, p.Nd_num, id});
+     else
+          wk.Q.push({p.lower, p.Nd_num, id});
+}
+
+void SearchPool::run(chrono::steady_clock::time_point since, const double *rootLoad, const Checkpoint *from)
+{
+     start = since;
+     if (from)
+          restore(*from);
+     else
+     {
+          uint32_t root = arena.alloc(NodeArena::NONE, -1, CLOUD, 0, 0.0);
+          double *load = arena.load(root);
+          if (rootLoad)
+               copy(rootLoad, rootLoad + k, load);
+          else
+               fill(load, load + k, 0.0);
+          arena[root].cost = 0.0;
+          arena[root].fixed = weightedSquares(load, coef.invF.data(), k);
+          arena[root].hash = 0;
+          push(*workers[0], root);
+     }
+     thread saver;
+     if (!opts.checkpoint.empty())
+          saver = thread([this] {
+               unique_lock<mutex> lock(saveMutex);
+               while (!saveCv.wait_for(lock, chrono::duration<double>(opts.checkpointEvery),
+                                       [this] { return finished; }))
+                    saveCheckpoint();
+          });
+     vector<thread> threads;
+     for (size_t i = 1; i < workers.size(); i++)
+          threads.emplace_back(&SearchPool::workerLoop, this, ref(*workers[i]));
+     workerLoop(*workers[0]);
+     for (auto &t : threads)
+          t.join();
+     if (saver.joinable())
+     {
+          {
+               lock_guard<mutex> lock(saveMutex);
+               finished = true;
+          }
+          saveCv.notify_all();
+          saver.join();
+          // What a limit left open, or nothing once the tree is exhausted
+          saveCheckpoint();
+     }
+}
+
+// Appends a delta to the checkpoint file: the tree nodes added since the
+// last write, the open nodes closed since and those opened. Once the file
+// holds more than twice the tree nodes that are live, most of them closed,
+// it is replaced by a full checkpoint instead.
+void SearchPool::saveCheckpoint()
+{
+     bool delta = savedNodes > 0 && savedNodes <= 2 * arena.live();
+     uint32_t base = delta ? savedNodes : 0;
+     Checkpoint cp;
+     snapshot(cp, true, delta);
+     vector<char> isOpen(base + cp.parent.size(), 0);
+     for (uint32_t t : cp.open)
+          isOpen[t] = 1;
+     vector<uint32_t> closed;
+     if (delta)
+     {
+          for (uint32_t t = 0; t < base; t++)
+               if (savedOpen[t] && !isOpen[t])
+                    closed.push_back(t);
+          size_t kept = 0;
+          for (size_t t = 0; t < cp.open.size(); t++)
+               if (cp.open[t] >= base || !savedOpen[cp.open[t]])
+               {
+                    cp.open[kept] = cp.open[t];
+                    cp.lower[kept++] = cp.lower[t];
+               }
+          cp.open.resize(kept);
+          cp.lower.resize(kept);
+     }
+     struct stat file;
+     if (!writeCheckpoint(opts.checkpoint, cp, base, closed) || stat(opts.checkpoint.c_str(), &file) != 0)
+     {
+          // The tree indexes in the nodes are void, the next one is full
+          savedNodes = 0;
+          cerr << "cannot write checkpoint " << opts.checkpoint << endl;
+          return;
+     }
+     savedNodes = isOpen.size();
+     savedOpen.swap(isOpen);
+     checkpoints++;
+     fullCheckpoints += !delta;
+     checkpointBytes = file.st_size;
+}
+
+// Copies the open lists under all worker locks, the only time the workers
+// wait, and pins those nodes with a reference; their paths are then read
+// and encoded without the locks.
+void SearchPool::snapshot(Checkpoint &cp, bool file, bool delta)
+{
+     vector<OpenNode> open;
+     {
+          vector<unique_lock<mutex>> locks;
+          for (auto &w : workers)
+               locks.emplace_back(w->m);
+          for (auto &w : workers)
+          {
+               if (w->currentId != NodeArena::NONE)
+                    open.push_back({w->current, 0, w->currentId});
+               w->Q.copyTo(open);
+               open.insert(open.end(), w->dive.begin(), w->dive.end());
+          }
+          for (const OpenNode &p : open)
+               arena[p.id].refs.fetch_add(1, memory_order_relaxed);
+     }
+
+     cp.instance = pre.hash;
+     cp.r_nk_e = r_nk_e;
+     cp.r_nk_c = r_nk_c;
+     double upper = incumbent.get();
+     cp.D = incumbent.assignment();
+     cp.expanded = expandedTotal.load(memory_order_relaxed);
+     uint32_t base = delta ? savedNodes : 0;
+     unordered_map<uint32_t, uint32_t> index;   // arena id -> tree index
+     vector<uint32_t> path;
+     vector<char> isOpen;
+     for (const OpenNode &p : open)
+     {
+          // The ancestors not in the tree yet, then the tree below them
+          uint32_t id = p.id, at = NodeArena::NONE;
+          path.clear();
+          while (id != NodeArena::NONE)
+          {
+               auto it = index.find(id);
+               if (it != index.end() || (delta && arena[id].saved != NodeArena::NONE))
+               {
+                    at = it != index.end() ? it->second : arena[id].saved;
+                    break;
+               }
+               path.push_back(id);
+               id = arena[id].parent;
+          }
+          for (size_t t = path.size(); t-- > 0;)
+          {
+               const node &q = arena[path[t]];
+               cp.parent.push_back(at);
+               cp.query.push_back(q.query);
+               cp.server.push_back(q.server);
+               at = base + cp.parent.size() - 1;
+               index[path[t]] = at;
+          }
+          isOpen.resize(base + cp.parent.size(), 0);
+          // A node in flight may also be in a frontier again
+          if (p.lower <= upper && !isOpen[at])
+          {
+               isOpen[at] = 1;
+               cp.open.push_back(at);
+               cp.lower.push_back(p.lower);
+          }
+     }
+     // The live nodes off these paths are new or have no open descendant
+     // left, so after a full snapshot no node a delta reaches keeps an
+     // index into an earlier file
+     if (file)
+          for (auto &at : index)
+               arena[at.first].saved = at.second;
+     for (const OpenNode &p : open)
+          arena.release(p.id);
+}
+
+// Rebuilds the decision tree of a checkpoint in the arena and queues its
+// open nodes, unsolved, over the workers
+void SearchPool::restore(const Checkpoint &cp)
+{
+     expandedTotal = cp.expanded;
+     vector<uint32_t> ids(cp.parent.size());
+     vector<char> isOpen(cp.parent.size(), 0);
+     for (size_t t = 0; t < cp.parent.size(); t++)
+     {
+          if (cp.parent[t] == NodeArena::NONE)
+          {
+               ids[t] = arena.alloc(NodeArena::NONE, -1, CLOUD, 0, 0.0);
+               node &root = arena[ids[t]];
+               root.cost = root.fixed = 0.0;
+               root.hash = 0;
+               fill(arena.load(ids[t]), arena.load(ids[t]) + k, 0.0);
+               continue;
+          }
+          uint32_t parent = ids[cp.parent[t]];
+          node &p = arena[parent];
+          ids[t] = arena.alloc(parent, cp.query[t], cp.server[t], p.Nd_num + 1, 0.0);
+          node &q = arena[ids[t]];
+          q.cost = p.cost;
+          q.fixed = p.fixed;
+          q.hash = p.hash ^ queryKey(cp.query[t], cp.server[t]);
+          copy(arena.load(parent), arena.load(parent) + k, arena.load(ids[t]));
+          fixQuery(arena.load(ids[t]), q.cost, q.fixed, cp.query[t], cp.server[t]);
+     }
+     for (size_t t = 0; t < cp.open.size(); t++)
+     {
+          node &p = arena[ids[cp.open[t]]];
+          p.lower = cp.lower[t];
+          p.solved = false;
+          isOpen[cp.open[t]] = 1;
+          push(*workers[t % workers.size()], ids[cp.open[t]]);
+     }
+     // Inner nodes are closed: only their children hold them
+     for (size_t t = 0; t < ids.size(); t++)
+          if (!isOpen[t])
+               arena.release(ids[t]);
+}
+
+bool SearchPool::steal(Worker& wk, OpenNode& p)
+{
+     size_t cnt = workers.size();
+     for (size_t i = 1; i < cnt; i++)
+     {
+          Worker &victim = *workers[(wk.id + i) % cnt];
+          unique_lock<mutex> lock(victim.m, try_to_lock);
+          if (!lock.owns_lock() || victim.Q.empty())
+               continue;
+          p = victim.Q.steal();
+          wk.current = p.lower;
+          wk.currentId = p.id;
+          wk.stolen++;
+          return true;
+     }
+     return false;
+}
+
+void SearchPool::workerLoop(Worker& wk)
+{
+     // Nodes per worker between two limit checks; a time limit is checked
+     // after every node, which may take long on a large instance
+     const int CHECK_EVERY = 16;
+
+     while (!stop.load(memory_order_relaxed))
+     {
+          OpenNode p;
+          bool found = false;
+          {
+               lock_guard<mutex> lock(wk.m);
+               wk.current = numeric_limits<double>::infinity();
+               wk.currentId = NodeArena::NONE;
+               if (!wk.dive.empty())
+               {
+                    p = wk.dive.back();
+                    wk.dive.pop_back();
+                    wk.current = p.lower;
+                    wk.currentId = p.id;
+                    found = true;
+               }
+               else
+               {
+                    // A dive ends with its subtree
+                    wk.diving = false;
+                    if (!wk.Q.empty())
+                    {
+                         p = wk.Q.pop();
+                         wk.current = p.lower;
+                         wk.currentId = p.id;
+                         found = true;
+                    }
+               }
+          }
+          if (!found && !steal(wk, p))
+          {
+               if (pending.load(memory_order_acquire) == 0)
+                    return;
+               this_thread::yield();
+               continue;
+          }
+          if (!wk.diving)
+          {
+               // The next dive starts from this node, own or stolen, while
+               // the open nodes are still over the budget
+               long long bytes = frontierBytes();
+               wk.diving = bytes >= memBudget;
+               wk.dives += wk.diving;
+               if (bytes > peakBytes.load(memory_order_relaxed))
+                    peakBytes.store(bytes, memory_order_relaxed);
+          }
+
+          // The incumbent may have improved since the node was pushed
+          node &nd = arena[p.id];
+          bool expand = p.lower <= incumbent.get();
+          if (!expand)
+          {
+               if (nd.solved)
+                    wk.pruned++;
+               else
+                    wk.skipped++;
+          }
+          else if (!nd.solved)
+          {
+               evaluateNode(*this, wk, p.id);
+               expand = nd.lower <= incumbent.get();
+               if (expand && requeue(wk, p.id))
+                    continue;
+          }
+          if (expand)
+          {
+               processNode(*this, wk, p.id);
+               wk.expanded++;
+               wk.dived += wk.diving;
+               long long total = expandedTotal.fetch_add(1, memory_order_relaxed) + 1;
+               if (wk.expanded % CHECK_EVERY == 0 || opts.timeLimit > 0.0 || (opts.nodeLimit > 0 && total >= opts.nodeLimit))
+                    checkLimits();
+          }
+          {
+               // A checkpoint must not see the node once it is released
+               lock_guard<mutex> lock(wk.m);
+               wk.currentId = NodeArena::NONE;
+          }
+          arena.release(p.id);
+          // Children are counted before the parent is retired
+          pending.fetch_sub(1, memory_order_acq_rel);
+     }
+}
+
+// A node whose bound rose above the best open one when it was solved goes
+// back to the frontier instead of being expanded; it stays pending
+bool SearchPool::requeue(Worker& wk, uint32_t id)
+{
+     node &p = arena[id];
+     lock_guard<mutex> lock(wk.m);
+     if (opts.search != SEARCH_BEST || wk.diving || wk.Q.empty() || p.lower <= wk.Q.minLower())
+          return false;
+     wk.Q.push({p.lower, p.Nd_num, id});
+     return true;
+}
+
+void SearchPool::checkLimits()
+{
+     const char *reason = nullptr;
+     double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+     if (opts.timeLimit > 0.0 && seconds >= opts.timeLimit)
+          reason = "time limit";
+     else if (opts.nodeLimit > 0 && expandedTotal.load(memory_order_relaxed) >= opts.nodeLimit)
+          reason = "node limit";
+     else if (opts.gap > 0.0 || opts.absGap > 0.0)
+     {
+          double upper = incumbent.get() + pre.offset;
+          double gap = upper - (lowerBound() + pre.offset);
+          if (gap <= opts.absGap || gap <= opts.gap * max(fabs(upper), 1e-10))
+               reason = "gap reached";
+     }
+     bool running = false;
+     if (reason && stop.compare_exchange_strong(running, true))
+          stopped = reason;
+}
+
+// Holds every frontier lock at once, so that no node is in flight between
+// two workers while the bounds are read; steals only try their lock.
+double SearchPool::lowerBound()
+{
+     vector<unique_lock<mutex>> locks;
+     for (auto &w : workers)
+          locks.emplace_back(w->m);
+     double lo = incumbent.get();
+     for (auto &w : workers)
+     {
+          lo = min(lo, min(w->current, w->Q.minLower()));
+          for (const OpenNode &p : w->dive)
+               lo = min(lo, p.lower);
+     }
+     return lo;
+}
+
+int PseudoCosts::select(const vector<int> &free)
+{
+     lock_guard<mutex> lock(m);
+     double fallback = seen ? scoreSum / seen : 0.0;
+     int best = -1;
+     double bestScore = -1.0;
+     for (int j : free)
+     {
+          double sc = count[j] ? score(j) : fallback;
+          if (sc > bestScore || (sc == bestScore && coef.impactRank[j] < coef.impactRank[best]))
+          {
+               best = j;
+               bestScore = sc;
+          }
+     }
+     return best;
+}
+
+uint32_t NodeArena::alloc(uint32_t parent, int query, int16_t server, int Nd_num, double lower)
+{
+     uint32_t id;
+     {
+          lock_guard<mutex> lock(m);
+          if (!freeIds.empty())
+          {
+               id = freeIds.back();
+               freeIds.pop_back();
+          }
+          else
+          {
+               id = used++;
+               if ((id & CHUNK_MASK) == 0 && !chunks[id >> CHUNK_BITS])
+               {
+                    chunks[id >> CHUNK_BITS].reset(new node[CHUNK_MASK + 1]);
+                    loadChunks[id >> CHUNK_BITS].reset(new double[(size_t)(CHUNK_MASK + 1) * k]);
+               }
+          }
+     }
+     size_t cnt = liveCnt.fetch_add(1, memory_order_relaxed) + 1;
+     size_t old = peakCnt.load(memory_order_relaxed);
+     while (cnt > old && !peakCnt.compare_exchange_weak(old, cnt, memory_order_relaxed))
+          ;
+
+     node &p = (*this)[id];
+     p.lower = lower;
+     p.parent = parent;
+     p.query = query;
+     p.server = server;
+     p.Nd_num = Nd_num;
+     p.branch = -1;
+     p.saved = NONE;
+     p.solved = true;
+     p.refs.store(1, memory_order_relaxed);
+     if (parent != NONE)
+          (*this)[parent].refs.fetch_add(1, memory_order_relaxed);
+     return id;
+}
+
+void NodeArena::release(uint32_t id)
+{
+     while (id != NONE)
+     {
+          node &p = (*this)[id];
+          if (p.refs.fetch_sub(1, memory_order_acq_rel) != 1)
+               return;
+          uint32_t parent = p.parent;
+          p.warm.reset();
+          p.excluded.reset();
+          liveCnt.fetch_sub(1, memory_order_relaxed);
+          {
+               lock_guard<mutex> lock(m);
+               freeIds.push_back(id);
+          }
+          id = parent;
+     }
+}
+
+void NodeArena::clear()
+{
+     lock_guard<mutex> lock(m);
+     for (uint32_t id = 0; id < used; id++)
+     {
+          (*this)[id].warm.reset();
+          (*this)[id].excluded.reset();
+     }
+     used = 0;
+     freeIds.clear();
+     liveCnt.store(0, memory_order_relaxed);
+     peakCnt.store(0, memory_order_relaxed);
+}
+
+void NodeArena::assignment(uint32_t id, Assignment& d)
+{
+     fill(d.begin(), d.end(), FREE);
+     for (; id != NONE; id = (*this)[id].parent)
+     {
+          node &p = (*this)[id];
+          if (p.query >= 0)
+               d[p.query] = p.server;
+     }
+}
+
+void processNode(SearchPool& pool, Worker& wk, uint32_t id) {
+    node &p = pool.arena[id];
+    if (p.Nd_num >= n)
+        return;
+
+    pool.arena.assignment(id, wk.d);
+    wk.free.clear();
+    for (int j = 0; j < n; j++)
+        if (wk.d[j] == FREE)
+            wk.free.push_back(j);
+    int index = selectBranch(pool, wk, p);
+    // Identical queries are decided in input order on non-decreasing servers
+    int low = groupBounds(wk.d, index, wk.blocked);
+    wk.childFree.clear();
+    for (int j : wk.free)
+        if (j != index)
+            wk.childFree.push_back(j);
+
+    // First tier of the bound cascade: the fixed part of a child plus the
+    // least transfer cost of its free queries, O(1) per child. Lazy children
+    // are queued with it, or the parent's bound if higher. Pseudo-costs learn
+    // from whole branchings, so their children are solved here.
+    bool lazy = opts.lazy && opts.branch != BRANCH_PSEUDOCOST;
+    double freeCost = 0.0;
+    for (int j : wk.childFree)
+        freeCost += coef.minCost[j];
+
+    // Branch on query index: the cloud first, then every executable ES
+    const double *load = pool.arena.load(id);
+    vector<Child> &children = wk.children;
+    vector<double> &lowers = wk.lowers;
+    children.clear();
+    lowers.clear();
+    bool heuristics = opts.heuristics && opts.heuristicFreq > 0 && wk.expanded % opts.heuristicFreq == 0;
+    for (int i = low; i < k; i++) {
+        if (i != CLOUD && e[index][i] != 1)
+            continue;
+        if (isExcluded(p.excluded.get(), index, i)) {
+            wk.rcSkipped++;
+            continue;
+        }
+        if (i != CLOUD && opts.symmetry && isMirrored(i, load, wk.blocked)) {
+            wk.symmetric++;
+            continue;
+        }
+        wk.d[index] = i;
+
+        Child child;
+        child.server = i;
+        double cost = p.cost, fixed = p.fixed;
+        copy(load, load + k, wk.load.begin());
+        fixQuery(wk.load.data(), cost, fixed, index, i);
+        if (opts.cascade && fixed + freeCost > pool.incumbent.get()) {
+            wk.tierPruned[0]++;
+            lowers.push_back(fixed + freeCost);
+            continue;
+        }
+        if (pool.table && !pool.table->visit(stateKey(p.hash ^ queryKey(index, i), wk.load.data()), cost)) {
+            wk.transposed++;
+            continue;
+        }
+        if (lazy) {
+            child.lower = opts.cascade ? max(p.lower, fixed + freeCost) : p.lower;
+            child.branch = -1;
+            child.warm = p.warm;
+            child.excluded = p.excluded;
+            children.push_back(move(child));
+            continue;
+        }
+        PartialAssignment part = {&wk.d, p.Nd_num + 1, wk.load.data(), cost, &wk.childFree, p.excluded.get()};
+        const vector<double> *optionLower;
+        child.lower = calcProblem(wk, part, p.warm.get(), child.warm, pool.incumbent.get(), optionLower);
+        child.branch = wk.fractional;
+        child.excluded = fixByReducedCost(wk, optionLower, wk.childFree, p.excluded, pool.incumbent.get());
+        if (pool.incumbent.offer(calcTargetVal(wk.d_upper, part, wk.target), wk.d_upper) && opts.verbose)
+            cout << "new incumbent: " << pool.incumbent.get() << endl;
+        if (heuristics)
+            runHeuristics(pool.incumbent, part, &wk.d_upper, wk.heur, wk.heurLoad);
+        lowers.push_back(child.lower);
+        children.push_back(move(child));
+    }
+    // The root has no bound of its own to measure gains against
+    if (opts.branch == BRANCH_PSEUDOCOST && p.query >= 0)
+        pool.pseudo.update(index, p.lower, lowers);
+
+    // A dive continues with the best child, which is pushed last
+    if (wk.diving)
+        stable_sort(children.begin(), children.end(),
+                    [](const Child &a, const Child &b) { return a.lower > b.lower; });
+    double min_upper = pool.incumbent.get();
+    for (size_t i = 0; i < children.size(); i++) {
+        if (children[i].lower > min_upper)
+            continue;
+        uint32_t cid = pool.arena.alloc(id, index, children[i].server, p.Nd_num + 1, children[i].lower);
+        node &child = pool.arena[cid];
+        child.cost = p.cost;
+        child.fixed = p.fixed;
+        child.branch = children[i].branch;
+        child.solved = !lazy;
+        child.hash = p.hash ^ queryKey(index, children[i].server);
+        child.warm = move(children[i].warm);
+        child.excluded = move(children[i].excluded);
+        double *child_load = pool.arena.load(cid);
+        copy(load, load + k, child_load);
+        fixQuery(child_load, child.cost, child.fixed, index, children[i].server);
+        pool.push(wk, cid);
+    }
+    // Frees the warm starts of the children pruned above
+    children.clear();
+}
+
+// Solves the relaxation of a node queued with an inherited bound, from its
+// parent's warm start
+void evaluateNode(SearchPool& pool, Worker& wk, uint32_t id) {
+    node &p = pool.arena[id];
+    pool.arena.assignment(id, wk.d);
+    wk.free.clear();
+    for (int j = 0; j < n; j++)
+        if (wk.d[j] == FREE)
+            wk.free.push_back(j);
+    PartialAssignment part = {&wk.d, p.Nd_num, pool.arena.load(id), p.cost, &wk.free, p.excluded.get()};
+    shared_ptr<const WarmStart> warm;
+    const vector<double> *optionLower;
+    p.lower = max(p.lower, calcProblem(wk, part, p.warm.get(), warm, pool.incumbent.get(), optionLower));
+    p.branch = wk.fractional;
+    p.warm = move(warm);
+    p.excluded = fixByReducedCost(wk, optionLower, wk.free, p.excluded, pool.incumbent.get());
+    p.solved = true;
+    if (pool.incumbent.offer(calcTargetVal(wk.d_upper, part, wk.target), wk.d_upper) && opts.verbose)
+        cout << "new incumbent: " << pool.incumbent.get() << endl;
+    if (opts.heuristics && opts.heuristicFreq > 0 && wk.solved % opts.heuristicFreq == 0)
+        runHeuristics(pool.incumbent, part, &wk.d_upper, wk.heur, wk.heurLoad);
+}
+
+// A server is a mirror of a lower-indexed one of its class that carries the
+// same load: the free queries see both the same way, so swapping the two in
+// any completion keeps it feasible and its cost, and only the lower one needs
+// to be branched on. The swap must not break the order of a query group,
+// hence no blocked server may lie between the two.
+bool isMirrored(int i, const double *load, const vector<char> &blocked) {
+    int first = coef.serverClass[i];
+    for (int i2 = i - 1; i2 >= first && !blocked[i2 + 1]; i2--)
+        if (coef.serverClass[i2] == first && load[i2] == load[i])
+            return true;
+    return false;
+}
+
+// Identical queries (same c, w and e row) are decided in input order on
+// non-decreasing servers, the cloud first: any assignment can be permuted
+// into that form at the same cost. Moves j to the first free query of its
+// group and returns the least server it may take. blocked gets the servers
+// that the groups with free queries left have reached.
+int groupBounds(const Assignment &d, int &j, vector<char> &blocked) {
+    fill(blocked.begin(), blocked.end(), 0);
+    int low = CLOUD;
+    for (int h : coef.groupHeads) {
+        int last = CLOUD, t = h;
+        for (; t >= 0 && d[t] != FREE; t = coef.groupNext[t])
+            last = d[t];
+        if (t < 0)
+            continue;
+        if (last != CLOUD)
+            blocked[last] = 1;
+        if (h == coef.groupHead[j]) {
+            j = t;
+            low = last;
+        }
+    }
+    return low;
+}
+
+// Query to branch on at node p, whose free queries are in wk.free
+int selectBranch(SearchPool& pool, Worker& wk, const node& p) {
+    switch (opts.branch) {
+    case BRANCH_INPUT:
+        return wk.free[0];
+    case BRANCH_FRACTIONAL:
+        if (p.branch >= 0 && wk.d[p.branch] == FREE)
+            return p.branch;
+        break;
+    case BRANCH_PSEUDOCOST:
+        return pool.pseudo.select(wk.free);
+    default:
+        break;
+    }
+    for (int j : coef.impactOrder)
+        if (wk.d[j] == FREE)
+            return j;
+    return wk.free[0];
+}
+
+// Zobrist key of query j being fixed. Grouped queries include their server,
+// since it constrains the rest of their group (see groupBounds).
+uint64_t queryKey(int j, int server)
+{
+     if (coef.groupHead[j] == j && coef.groupNext[j] < 0)
+          return mix64((uint64_t)j);
+     return mix64(((uint64_t)j << 20) ^ (uint64_t)(server + 2) ^ 0x5851f42d4c957f2dULL);
+}
+
+// Transposition key of a node: its fixed queries and its quantized loads
+uint64_t stateKey(uint64_t hash, const double *load)
+{
+     uint64_t key = hash;
+     for (int i = 0; i < k; i++)
+          key = mix64(key ^ (uint64_t)llround(load[i] / coef.loadQuantum));
+     return key;
+}
+
+// Adds query j on server (or CLOUD) to the aggregates of a partial
+// assignment in O(1): only the load of that server moves.
+void fixQuery(double *load, double &cost, double &fixed, int j, int server)
+{
+     if (server != CLOUD && e[j][server])
+     {
+          double a = coef.sqrtC[j];
+          double l = load[server];
+          fixed += (2.0 * l + a) * a * coef.invF[server] + coef.costEdge[j];
+          cost += coef.costEdge[j];
+          load[server] = l + a;
+     }
+     else
+     {
+          fixed += coef.costCloud[j];
+          cost += coef.costCloud[j];
+     }
+}
+
+// Objective of D_upper, a completion of part: only the free queries are
+// summed, the fixed ones come from the aggregates. load is scratch, so that
+// the callers in loops do not allocate.
+double calcTargetVal(const Assignment &D_upper, const PartialAssignment &part, vector<double> &load)
+{
+     double obj = part.cost;
+     load.assign(part.load, part.load + k);
+     for (int j : *part.free)
+     {
+          int i = D_upper[j];
+          if (i != CLOUD && e[j][i])
+          {
+               load[i] += coef.sqrtC[j];
+               obj += coef.costEdge[j];
+          }
+          else
+               obj += coef.costCloud[j];
+     }
+     return obj + weightedSquares(load.data(), coef.invF.data(), k);
+}
+
+// Second tier of the bound cascade, O(k log k + n). Every free query may
+// use any server and the servers share the edge load by water-filling, so
+// the load cost G(X) = min sum_i (L_i + x_i)^2 / F_i only depends on the
+// total X; G is convex with G'(X) = 2 lambda, lambda the water level
+// (L_i + x_i) / F_i of the servers in use. As in LagrangianBound::server,
+// queries enter by decreasing -lin / a until G' catches up.
+double analyticBound(const PartialAssignment &part, vector<int> &servers)
+{
+     const Assignment &d = *part.d;
+     const double *L = part.load;
+     double val = part.cost;
+     for (int j : *part.free)
+          val += coef.costCloud[j];
+     if (k == 0)
+          return val;
+
+     sort(servers.begin(), servers.end(),
+          [&](int i1, int i2) { return L[i1] * coef.invF[i1] < L[i2] * coef.invF[i2]; });
+     double squares = weightedSquares(L, coef.invF.data(), k);
+     int active = 0;
+     double SF = 0.0, SL = 0.0;   // capability and fixed load of the servers in use
+     // Water level at total edge load X; X never decreases between calls
+     auto level = [&](double X) {
+          while (active < k && (active == 0 || X >= L[servers[active]] * coef.invF[servers[active]] * SF - SL))
+          {
+               int i = servers[active++];
+               SF += F[i];
+               SL += L[i];
+               squares -= L[i] * L[i] * coef.invF[i];
+          }
+          return (X + SL) / SF;
+     };
+
+     double X = 0.0;
+     for (int j : coef.byRatio)
+     {
+          if (d[j] != FREE)
+               continue;
+          double a = coef.sqrtC[j], b = coef.lin[j];
+          if (a == 0.0)
+          {
+               val += b;
+               continue;
+          }
+          double r = -b / a;
+          if (r <= 2.0 * level(X))
+               break;
+          if (r >= 2.0 * level(X + a))
+          {
+               X += a;
+               val += b;
+               continue;
+          }
+          // Partly: up to the load at which the level reaches r / 2
+          double target = 0.0;
+          for (int i = 0; i < k; i++)
+               target += max(0.0, r / 2.0 * F[i] - L[i]);
+          val += b * (target - X) / a;
+          X = target;
+          break;
+     }
+     double lambda = level(X);
+     return val + lambda * lambda * SF + squares;
+}
+
+// Fill coef from the instance and the measured bandwidths
+void buildCoefficients()
+{
+     int kp = (k + 7) / 8 * 8;
+     coef.kp = kp;
+     coef.a.assign((size_t)n * kp, 0.0);
+     coef.mask.assign((size_t)n * kp, 0.0);
+     coef.invF.assign(kp, 0.0);
+     coef.sqrtC.resize(n);
+     coef.costEdge.resize(n);
+     coef.costCloud.resize(n);
+     coef.lin.resize(n);
+     coef.minCost.resize(n);
+     for (int i = 0; i < k; i++)
+          coef.invF[i] = 1.0 / F[i];
+     for (int j = 0; j < n; j++)
+     {
+          coef.sqrtC[j] = sqrt(c[j]);
+          coef.costEdge[j] = w[j] / r_nk_e;
+          coef.costCloud[j] = w[j] / r_nk_c;
+          coef.lin[j] = coef.costEdge[j] - coef.costCloud[j];
+          coef.minCost[j] = coef.costCloud[j];
+          for (int i = 0; i < k; i++)
+               if (e[j][i])
+               {
+                    coef.minCost[j] = min(coef.costCloud[j], coef.costEdge[j]);
+                    break;
+               }
+          for (int i = 0; i < k; i++)
+          {
+               coef.mask[j * kp + i] = e[j][i] ? 1.0 : 0.0;
+               coef.a[j * kp + i] = e[j][i] ? coef.sqrtC[j] : 0.0;
+          }
+     }
+     double total = 0.0;
+     for (int j = 0; j < n; j++)
+          total += coef.sqrtC[j];
+     coef.loadQuantum = 1e-9 * max(1.0, total);
+     coef.byRatio.clear();
+     for (int j = 0; j < n; j++)
+          if (coef.lin[j] < 0.0 && coef.minCost[j] < coef.costCloud[j])
+               coef.byRatio.push_back(j);
+     stable_sort(coef.byRatio.begin(), coef.byRatio.end(), [](int j1, int j2) {
+          // -lin / a compared without dividing, a may be 0
+          return -coef.lin[j1] * coef.sqrtC[j2] > -coef.lin[j2] * coef.sqrtC[j1];
+     });
+     coef.bySize.resize(n);
+     iota(coef.bySize.begin(), coef.bySize.end(), 0);
+     stable_sort(coef.bySize.begin(), coef.bySize.end(),
+                 [](int j1, int j2) { return coef.sqrtC[j1] > coef.sqrtC[j2]; });
+
+     // Impact of a query: its load cost c[j] / F_i on an average executable
+     // server plus what its transfer cost depends on the decision; queries
+     // with fewer executable servers first on ties, forced ones last
+     vector<double> impact(n, 0.0);
+     vector<int> options(n, 0);
+     for (int j = 0; j < n; j++)
+     {
+          double invF = 0.0;
+          for (int i = 0; i < k; i++)
+          {
+               if (!e[j][i])
+                    continue;
+               options[j]++;
+               invF += coef.invF[i];
+          }
+          if (options[j])
+               impact[j] = c[j] * invF / options[j] + fabs(coef.lin[j]);
+     }
+     coef.impactOrder.resize(n);
+     iota(coef.impactOrder.begin(), coef.impactOrder.end(), 0);
+     stable_sort(coef.impactOrder.begin(), coef.impactOrder.end(), [&](int j1, int j2) {
+          if (impact[j1] != impact[j2])
+               return impact[j1] > impact[j2];
+          return options[j1] < options[j2];
+     });
+     coef.impactRank.resize(n);
+     for (int t = 0; t < n; t++)
+          coef.impactRank[coef.impactOrder[t]] = t;
+
+     // Interchangeable servers: equal capability and executable queries
+     vector<int> servers(k);
+     iota(servers.begin(), servers.end(), 0);
+     auto column = [](int i1, int i2) {
+          if (F[i1] != F[i2])
+               return F[i1] < F[i2] ? -1 : 1;
+          for (int j = 0; j < n; j++)
+               if (e[j][i1] != e[j][i2])
+                    return e[j][i1] < e[j][i2] ? -1 : 1;
+          return 0;
+     };
+     stable_sort(servers.begin(), servers.end(), [&](int i1, int i2) { return column(i1, i2) < 0; });
+     coef.serverClass.resize(k);
+     for (int t = 0; t < k; t++)
+     {
+          int i = servers[t];
+          coef.serverClass[i] = t > 0 && column(servers[t - 1], i) == 0 ? coef.serverClass[servers[t - 1]] : i;
+     }
+
+     // Groups of identical queries, linked in input order
+     coef.groupHead.resize(n);
+     coef.groupNext.assign(n, -1);
+     coef.groupHeads.clear();
+     iota(coef.groupHead.begin(), coef.groupHead.end(), 0);
+     if (!opts.presolve)
+          return;
+     vector<int> queries(n);
+     iota(queries.begin(), queries.end(), 0);
+     auto row = [](int j1, int j2) {
+          if (c[j1] != c[j2])
+               return c[j1] < c[j2] ? -1 : 1;
+          if (w[j1] != w[j2])
+               return w[j1] < w[j2] ? -1 : 1;
+          for (int i = 0; i < k; i++)
+               if (e[j1][i] != e[j2][i])
+                    return e[j1][i] < e[j2][i] ? -1 : 1;
+          return 0;
+     };
+     stable_sort(queries.begin(), queries.end(), [&](int j1, int j2) { return row(j1, j2) < 0; });
+     for (int t = 1; t < n; t++)
+     {
+          int prev = queries[t - 1], j = queries[t];
+          if (row(prev, j) != 0)
+               continue;
+          coef.groupHead[j] = coef.groupHead[prev];
+          coef.groupNext[prev] = j;
+          if (coef.groupHead[j] == prev)
+               coef.groupHeads.push_back(prev);
+     }
+}
+
+// Reduces the instance to the queries and servers the search has to decide.
+// A query goes to the cloud if it has no executable server or if the cloud
+// costs no more than its cheapest server would even when empty,
+// w / r_nk_e + c / F[i]: moving it there from any server never raises the
+// objective. Servers that no remaining query can use are dropped. n, k and
+// the instance tables are replaced by the core, the original goes to pre.
+void presolve()
+{
+     pre.n = n;
+     pre.k = k;
+     pre.e = e;
+     pre.c = c;
+     pre.w = w;
+     pre.F = F;
+     pre.queries.clear();
+     pre.servers.clear();
+     vector<bool> used(k, !opts.presolve);
+     for (int j = 0; j < n; j++)
+     {
+          double edge = numeric_limits<double>::infinity();
+          for (int i = 0; i < k; i++)
+               if (e[j][i])
+                    edge = min(edge, w[j] / r_nk_e + (double)c[j] / F[i]);
+          double cloud = w[j] / r_nk_c;
+          if (opts.presolve && (edge == numeric_limits<double>::infinity() || cloud <= edge))
+          {
+               if (edge == numeric_limits<double>::infinity())
+                    pre.noServer++;
+               else
+                    pre.cheapCloud++;
+               pre.offset += cloud;
+               continue;
+          }
+          pre.queries.push_back(j);
+          for (int i = 0; i < k; i++)
+               if (e[j][i])
+                    used[i] = true;
+     }
+     for (int i = 0; i < k; i++)
+          if (used[i])
+               pre.servers.push_back(i);
+
+     n = pre.queries.size();
+     k = pre.servers.size();
+     e.assign(n, vector<int>(k));
+     c.resize(n);
+     w.resize(n);
+     F.resize(k);
+     for (int j = 0; j < n; j++)
+     {
+          c[j] = pre.c[pre.queries[j]];
+          w[j] = pre.w[pre.queries[j]];
+          for (int i = 0; i < k; i++)
+               e[j][i] = pre.e[pre.queries[j]][pre.servers[i]];
+     }
+     for (int i = 0; i < k; i++)
+          F[i] = pre.F[pre.servers[i]];
+}
+
+// Assignment of the original instance from one of the core
+Assignment postsolve(const Assignment &core)
+{
+     Assignment d(pre.n, CLOUD);
+     for (size_t j = 0; j < pre.queries.size(); j++)
+          if (core[j] != CLOUD)
+               d[pre.queries[j]] = pre.servers[core[j]];
+     return d;
+}
+
+// Rounding of a relaxed row that is always feasible: the query goes to the
+// largest of its executable D[j][i] and of the cloud share 1 - sum_i D[j][i].
+// frac gets 1 minus that largest share, 0 for an integral row.
+int16_t roundRow(const double *row, int j, double *frac)
+{
+     int16_t best = CLOUD;
+     double sum = 0.0;
+     for (int i = 0; i < k; i++)
+          if (e[j][i])
+               sum += row[i];
+     double bestVal = 1.0 - sum;
+     for (int i = 0; i < k; i++)
+     {
+          if (e[j][i] && row[i] > bestVal)
+          {
+               best = i;
+               bestVal = row[i];
+          }
+     }
+     if (frac)
+          *frac = max(0.0, 1.0 - bestVal);
+     return best;
+}
+
+// Completes part greedily: the free queries, largest first, each go to the
+// option of least marginal cost at the loads built so far
+double greedyComplete(const PartialAssignment &part, Assignment &d, vector<double> &load)
+{
+     load.assign(part.load, part.load + k);
+     d = *part.d;
+     for (int j : coef.bySize)
+     {
+          if (d[j] != FREE)
+               continue;
+          double a = coef.sqrtC[j];
+          int16_t best = CLOUD;
+          double bestCost = coef.costCloud[j];
+          for (int i = 0; i < k; i++)
+          {
+               if (!e[j][i])
+                    continue;
+               double marginal = (2.0 * load[i] + a) * a * coef.invF[i] + coef.costEdge[j];
+               if (marginal < bestCost)
+               {
+                    best = i;
+                    bestCost = marginal;
+               }
+          }
+          d[j] = best;
+          if (best != CLOUD)
+               load[best] += a;
+     }
+     return calcTargetVal(d, part, load);
+}
+
+// First-improvement local search over the free queries of d: moves of one
+// query to another server or the cloud, then swaps of two queries between
+// their servers. Every delta only involves the loads of the servers touched.
+double localSearch(const PartialAssignment &part, Assignment &d, vector<double> &load)
+{
+     const int PASSES = 20;
+     const int SWAP_LIMIT = 2000;   // free queries beyond which swaps are skipped
+     const double EPS = 1e-9;
 
-// the amount of computation
-// the result size
-vector<int> c, w; 
+     const vector<int> &free = *part.free;
+     load.assign(part.load, part.load + k);
+     for (int j : free)
+     {
+          if (d[j] != CLOUD && !e[j][d[j]])
+               d[j] = CLOUD;
+          if (d[j] != CLOUD)
+               load[d[j]] += coef.sqrtC[j];
+     }
 
-// the computational capability
-vector<int> F;
+     bool improved = true;
+     for (int pass = 0; improved && pass < PASSES; pass++)
+     {
+          improved = false;
+          for (int j : free)
+          {
+               int s = d[j];
+               double a = coef.sqrtC[j];
+               double out = s == CLOUD ? -coef.costCloud[j]
+                                       : -((2.0 * load[s] - a) * a * coef.invF[s] + coef.costEdge[j]);
+               int best = s;
+               double bestDelta = -EPS;
+               if (s != CLOUD && out + coef.costCloud[j] < bestDelta)
+               {
+                    best = CLOUD;
+                    bestDelta = out + coef.costCloud[j];
+               }
+               for (int t = 0; t < k; t++)
+               {
+                    if (t == s || !e[j][t])
+                         continue;
+                    double delta = out + (2.0 * load[t] + a) * a * coef.invF[t] + coef.costEdge[j];
+                    if (delta < bestDelta)
+                    {
+                         best = t;
+                         bestDelta = delta;
+                    }
+               }
+               if (best == s)
+                    continue;
+               if (s != CLOUD)
+                    load[s] -= a;
+               if (best != CLOUD)
+                    load[best] += a;
+               d[j] = best;
+               improved = true;
+          }
 
-int main(int argc,
-         char *argv[])
+          if (free.size() > (size_t)SWAP_LIMIT)
+               continue;
+          for (size_t t1 = 0; t1 < free.size(); t1++)
+          {
+               for (size_t t2 = t1 + 1; t2 < free.size(); t2++)
+               {
+                    int j1 = free[t1], j2 = free[t2];
+                    int s1 = d[j1], s2 = d[j2];
+                    if (s1 == CLOUD || s2 == CLOUD || s1 == s2 || !e[j1][s2] || !e[j2][s1])
+                         continue;
+                    double diff = coef.sqrtC[j2] - coef.sqrtC[j1];
+                    double delta = diff * (2.0 * load[s1] + diff) * coef.invF[s1]
+                                 - diff * (2.0 * load[s2] - diff) * coef.invF[s2];
+                    if (delta >= -EPS)
+                         continue;
+                    load[s1] += diff;
+                    load[s2] -= diff;
+                    d[j1] = s2;
+                    d[j2] = s1;
+                    improved = true;
+               }
+          }
+     }
+     return calcTargetVal(d, part, load);
+}
+
+// Greedy completion of part followed by local search and, when given,
+// local search from a rounded relaxation; both go to the incumbent
+void runHeuristics(Incumbent &incumbent, const PartialAssignment &part, const Assignment *rounded,
+                   Assignment &d, vector<double> &load)
 {
-     initializeParameters();
+     greedyComplete(part, d, load);
+     incumbent.offer(localSearch(part, d, load), d);
+     if (!rounded)
+          return;
+     d = *rounded;
+     incumbent.offer(localSearch(part, d, load), d);
+}
+
+NativeRelaxation::NativeRelaxation()
+    : x(n * coef.kp), y(n * coef.kp), xPrev(n * coef.kp), g(n * coef.kp), load(coef.kp), scaled(coef.kp), sorted(k)
+{
+}
 
-     r_nk_c = test_bandwidth(cloud_ip);
-     for(int i=0;i<k;i++) r_nk_e+=test_bandwidth(edge_servers_ip[i]);
-     r_nk_e=r_nk_e/k;
+// Relaxed objective without the constant part (fixed queries' transfer
+// costs and the cloud cost of every free query)
+double NativeRelaxation::objective(const AlignedVector &v, const vector<int> &free, const double *fixedLoad)
+{
+     int kp = coef.kp;
+     double obj = 0.0;
+     copy(fixedLoad, fixedLoad + k, load.begin());
+     for (int j : free)
+     {
+          multiplyAdd(load.data(), &coef.a[j * kp], &v[j * kp], kp);
+          obj += coef.lin[j] * dot(&coef.mask[j * kp], &v[j * kp], kp);
+     }
+     return obj + weightedSquares(load.data(), coef.invF.data(), kp);
+}
 
-     auto start = chrono::high_resolution_clock::now();
+// g = gradient at v, zero on the non-executable entries and the padding
+void NativeRelaxation::gradient(const AlignedVector &v, const vector<int> &free, const double *fixedLoad)
+{
+     int kp = coef.kp;
+     copy(fixedLoad, fixedLoad + k, load.begin());
+     for (int j : free)
+          multiplyAdd(load.data(), &coef.a[j * kp], &v[j * kp], kp);
+     for (int i = 0; i < kp; i++)
+          scaled[i] = 2.0 * load[i] * coef.invF[i];
+     for (int j : free)
+          gradientRow(&g[j * kp], scaled.data(), &coef.a[j * kp], &coef.mask[j * kp], coef.lin[j], kp);
+}
 
-     queue<node> Q;
-     node p;
-     p.Nd_num = 0;
-     p.d = {};
-     p.d_upper.assign(n, vector<int>(k, 0));
-     calcTargetVal(p);
-     double min_upper = p.upper;
-     vector<vector<int>> best_D;
-     cout << "min_upper:" << min_upper << endl;
-     Q.push(p);
-     while (!Q.empty())
+// Euclidean projection of one row onto {x >= 0, sum x <= 1, x_i = 0 if
+// !e[j][i] or server i is excluded for j}
+void NativeRelaxation::project(double *row, int j, const Exclusions *ex)
+{
+     const double *mask = &coef.mask[j * coef.kp];
+     double sum = 0.0;
+     for (int i = 0; i < k; i++)
      {
-          p = Q.front();
-          Q.pop();
-          processNode(Q, p, min_upper, best_D);
-          
+          if (mask[i] == 0.0 || row[i] < 0.0 || (ex && isExcluded(ex, j, i)))
+               row[i] = 0.0;
+          sum += row[i];
      }
+     if (sum <= 1.0)
+          return;
 
-     cout << "bestD: " << endl;
-     for (int i = 0; i < n; i++)
+     // Onto the simplex sum x = 1: x_i = max(row_i - tau, 0)
+     double *v = sorted.data();
+     int m = 0;
+     for (int i = 0; i < k; i++)
+          if (row[i] > 0.0)
+               v[m++] = row[i];
+     sort(v, v + m, greater<double>());
+     double cum = 0.0, tau = 0.0;
+     for (int t = 0; t < m; t++)
      {
-          for (int j = 0; j < k; j++)
+          cum += v[t];
+          double cand = (cum - 1.0) / (t + 1);
+          if (t + 1 == m || v[t + 1] <= cand)
           {
-               cout << best_D[i][j] << " ";
+               tau = cand;
+               break;
           }
-          cout << endl;
      }
-     vector<vector<double>> f(n, vector<double>(k));
-     vector<double> fm(k);
      for (int i = 0; i < k; i++)
+          row[i] = max(row[i] - tau, 0.0);
+}
+
+double NativeRelaxation::solve(const PartialAssignment &part, const WarmStart *start,
+                               Assignment &d_upper, WarmStart *warm)
+{
+     const Assignment &d = *part.d;
+     const vector<int> &free = *part.free;
+     const double *fixedLoad = part.load;
+     int kp = coef.kp;
+
+     // Constant part: the fixed queries, and the cloud cost of the free ones
+     double constant = part.cost;
+     for (int j : free)
+          constant += coef.costCloud[j];
+
+     // Step size from the Lipschitz constant of the gradient: the Hessian is
+     // block diagonal per server with rank-one blocks 2 a_i a_i' / F_i
+     fill(scaled.begin(), scaled.end(), 0.0);
+     for (int j : free)
+          multiplyAdd(scaled.data(), &coef.a[j * kp], &coef.a[j * kp], kp);
+     double lip = 0.0;
+     for (int i = 0; i < k; i++)
+          lip = max(lip, 2.0 * scaled[i] * coef.invF[i]);
+
+     fill(x.begin(), x.end(), 0.0);
+     if (start && !start->x.empty())
      {
-          for (int j = 0; j < n; j++)
+          for (int j : free)
           {
-               fm[i] += best_D[j][i] * e[j][i] * sqrt(c[j]);
+               for (int i = 0; i < k; i++)
+                    x[j * kp + i] = start->x[j * k + i];
+               project(&x[j * kp], j, part.excluded);
           }
      }
-     for (int i = 0; i < n; i++)
+
+     double best_lower = -numeric_limits<double>::infinity();
+     double fx = objective(x, free, fixedLoad);
+     if (!free.empty() && lip > 0.0)
      {
-          for (int j = 0; j < k; j++)
+          for (int j : free)
+               copy(&x[j * kp], &x[j * kp] + kp, &y[j * kp]);
+          double t = 1.0;
+          for (int it = 0; it < opts.nativeIters; it++)
           {
-               if (best_D[i][j] == 0)
+               iterations++;
+               // Frank-Wolfe bound at x, then a projected gradient step from y
+               gradient(x, free, fixedLoad);
+               double fw = fx;
+               for (int j : free)
                {
-                    f[i][j] = 0;
-                    cout << f[i][j] << " ";
-                    continue;
+                    fw -= dot(&g[j * kp], &x[j * kp], kp);
+                    double best = 0.0;
+                    for (int i = 0; i < k; i++)
+                         if (!part.excluded || !isExcluded(part.excluded, j, i))
+                              best = min(best, g[j * kp + i]);
+                    fw += best;
+               }
+               best_lower = max(best_lower, fw);
+               if (fx - best_lower <= opts.nativeTol * max(1.0, fabs(fx + constant)) ||
+                   best_lower + constant > cutoff)
+                    break;
+
+               gradient(y, free, fixedLoad);
+               for (int j : free)
+               {
+                    copy(&x[j * kp], &x[j * kp] + kp, &xPrev[j * kp]);
+                    lincomb(&x[j * kp], &y[j * kp], &g[j * kp], 1.0, -1.0 / lip, kp);
+                    project(&x[j * kp], j, part.excluded);
+               }
+               double fnew = objective(x, free, fixedLoad);
+               double tNext = (1.0 + sqrt(1.0 + 4.0 * t * t)) / 2.0;
+               if (fnew > fx)
+               {
+                    // Restart the momentum when the objective goes up
+                    tNext = 1.0;
+                    for (int j : free)
+                         copy(&x[j * kp], &x[j * kp] + kp, &y[j * kp]);
+               }
+               else
+               {
+                    double beta = (t - 1.0) / tNext;
+                    for (int j : free)
+                         lincomb(&y[j * kp], &x[j * kp], &xPrev[j * kp], 1.0 + beta, -beta, kp);
                }
-               f[i][j] = F[j] * sqrt(c[i]) / fm[j];
-               cout << f[i][j] << " ";
+               t = tNext;
+               fx = fnew;
           }
-          cout << endl;
      }
-     cout << "bestTarget: " << min_upper << endl;
+     else
+          best_lower = fx;
 
-     auto end = chrono::high_resolution_clock::now();
-     auto duration = chrono::duration_cast<chrono::microseconds>(end - start)/1000;
+     // Reduced-cost bounds: the Frank-Wolfe bound at x with row j held at one
+     // vertex, fw + g_ji - min(0, min_s g_js), and at 0 for the cloud
+     optionLower.clear();
+     if (opts.reducedCost && !free.empty() && lip > 0.0 && best_lower + constant <= cutoff)
+     {
+          optionLower.resize(n * (k + 1));
+          gradient(x, free, fixedLoad);
+          double fw = fx;
+          for (int j : free)
+          {
+               double best = 0.0;
+               for (int i = 0; i < k; i++)
+                    if (!part.excluded || !isExcluded(part.excluded, j, i))
+                         best = min(best, g[j * kp + i]);
+               fw += best - dot(&g[j * kp], &x[j * kp], kp);
+               optionLower[j * (k + 1)] = best;
+          }
+          for (int j : free)
+          {
+               double *row = &optionLower[j * (k + 1)];
+               row[0] = fw + constant - row[0];
+               for (int i = 0; i < k; i++)
+                    row[i + 1] = row[0] + g[j * kp + i];
+          }
+     }
 
-     cout << "Execution time: " << duration.count() << " ms" << endl;
-     
-     return 0;
-}
+     if (warm)
+     {
+          warm->x.resize(n * k);
+          for (int j = 0; j < n; j++)
+               for (int i = 0; i < k; i++)
+                    warm->x[j * k + i] = x[j * kp + i];
+     }
 
-void processNode(queue<node>& Q, node& p, double& min_upper, vector<vector<int>>& best_D) {
-    int index = p.Nd_num;
-    if (index >= n)
-        return;
+     fractional = -1;
+     double worst = 0.0;
+     for (int j = 0; j < n; j++)
+     {
+          if (d[j] != FREE)
+          {
+               d_upper[j] = d[j];
+               continue;
+          }
+          if (opts.verbose)
+               for (int i = 0; i < k; i++)
+                    cout << "D_" << j << "_" << i << " " << x[j * kp + i] << endl;
+          double frac;
+          d_upper[j] = roundRow(&x[j * kp], j, &frac);
+          if (frac > worst)
+          {
+               worst = frac;
+               fractional = j;
+          }
+     }
+     return best_lower + constant;
+}
 
-    vector<vector<int>> determinedD = p.d;
-    node p_cloud;
-    p_cloud.Nd_num = index + 1;
-    determinedD.push_back({0, 0});
-    p_cloud.d = determinedD;
-    calcProblem(p_cloud);
-    calcTargetVal(p_cloud);
-
-    if (min_upper > p_cloud.upper) {
-        min_upper = p_cloud.upper;
-        best_D = p_cloud.d_upper;
-    }
+LagrangianBound::LagrangianBound() : lambda(n), bestLambda(n), x(n * k), items(n)
+{
+}
 
-    vector<node> p_edge;
-    for (int i = 0; i < k; i++) {
-        vector<int> T(k, 0);
-        if (e[index][i] == 1) {
-            T[i] = 1;
-            node p_e;
-            p_e.Nd_num = index + 1;
-            vector<vector<int>> determinedD_edge = p.d;
-            determinedD_edge.push_back(T);
-            p_e.d = determinedD_edge;
-            calcProblem(p_e);
-            calcTargetVal(p_e);
-
-            if (min_upper > p_e.upper) {
-                min_upper = p_e.upper;
-                best_D = p_e.d_upper;
-            }
-            p_edge.push_back(p_e);
-        }
-    }
+// Minimises (L0 + sum_j a_j x_j)^2 / F_i + sum_j b_j x_j, b_j = lin_j + lambda_j,
+// over x in [0, 1] for the free queries executable on server i. The cost is
+// convex in the load, so queries enter by decreasing -b_j / a_j until the
+// marginal load cost 2 (L0 + T) / F_i catches up; the last one may be partial.
+double LagrangianBound::server(int i, const vector<int> &free, double L0)
+{
+     double invF = coef.invF[i];
+     double val = 0.0;
+     int m = 0;
+     for (int j : free)
+     {
+          if (!e[j][i])
+               continue;
+          double b = coef.lin[j] + lambda[j];
+          x[j * k + i] = 0.0;
+          if (b >= 0.0)
+               continue;
+          if (coef.sqrtC[j] == 0.0)
+          {
+               x[j * k + i] = 1.0;
+               val += b;
+          }
+          else
+               items[m++] = j;
+     }
+     sort(items.begin(), items.begin() + m, [this](int j1, int j2) {
+          return (coef.lin[j1] + lambda[j1]) / coef.sqrtC[j1] < (coef.lin[j2] + lambda[j2]) / coef.sqrtC[j2];
+     });
 
-    if (p_cloud.lower <= min_upper)
-        Q.push(p_cloud);
-    
-    for (int i = 0; i < p_edge.size(); i++) {
-        if (p_edge[i].lower <= min_upper)
-            Q.push(p_edge[i]);
-    }
+     double T = 0.0;
+     for (int t = 0; t < m; t++)
+     {
+          int j = items[t];
+          double a = coef.sqrtC[j], b = coef.lin[j] + lambda[j];
+          double r = -b / a;
+          if (r <= 2.0 * (L0 + T) * invF)
+               break;
+          if (r >= 2.0 * (L0 + T + a) * invF)
+          {
+               x[j * k + i] = 1.0;
+               T += a;
+               val += b;
+               continue;
+          }
+          double part = (r / (2.0 * invF) - L0 - T) / a;
+          x[j * k + i] = part;
+          T += part * a;
+          val += part * b;
+          break;
+     }
+     return (L0 + T) * (L0 + T) * invF + val;
 }
 
-double calcTargetVal(node &p)
+double LagrangianBound::solve(const PartialAssignment &part, const WarmStart *start,
+                              Assignment &d_upper, WarmStart *warm)
 {
-     vector<vector<int>> D_upper = p.d_upper;
-     double obj = 0.0;
-     for (int i = 0; i < k; i++)
+     const Assignment &d = *part.d;
+     const vector<int> &free = *part.free;
+
+     double constant = part.cost;
+     for (int j : free)
      {
-          double tmp = 0.0;
-          for (int j = 0; j < n; j++)
+          constant += coef.costCloud[j];
+          lambda[j] = start && (int)start->lambda.size() == n ? start->lambda[j] : 0.0;
+     }
+
+     double best = -numeric_limits<double>::infinity();
+     double theta = 2.0;
+     int stall = 0;
+     for (int it = 0; it < opts.lagrangeIters; it++)
+     {
+          iterations++;
+          double val = constant;
+          for (int j : free)
+               val -= lambda[j];
+          for (int i = 0; i < k; i++)
+               val += server(i, free, part.load[i]);
+
+          if (val > best)
+          {
+               best = val;
+               for (int j : free)
+                    bestLambda[j] = lambda[j];
+               stall = 0;
+          }
+          else if (++stall >= 5)
+          {
+               theta /= 2.0;
+               stall = 0;
+          }
+
+          // Subgradient sum_i x_ji - 1, projected on lambda >= 0
+          double norm = 0.0;
+          for (int j : free)
+          {
+               double g = -1.0;
+               for (int i = 0; i < k; i++)
+                    g += x[j * k + i] * e[j][i];
+               if (lambda[j] > 0.0 || g > 0.0)
+                    norm += g * g;
+          }
+          if (best > cutoff || norm == 0.0 || theta < 1e-3)
+               break;
+          double target = cutoff < numeric_limits<double>::infinity() ? cutoff : best + 0.05 * fabs(best) + 1.0;
+          double step = theta * (target - val) / norm;
+          for (int j : free)
           {
-               tmp += D_upper[j][i] * e[j][i] * sqrt(c[j]);
+               double g = -1.0;
+               for (int i = 0; i < k; i++)
+                    g += x[j * k + i] * e[j][i];
+               lambda[j] = max(0.0, lambda[j] + step * g);
           }
-          obj += tmp * tmp / F[i];
      }
-     for (int i = 0; i < k; i++)
+
+     if (warm)
      {
-          for (int j = 0; j < n; j++)
+          warm->lambda.assign(n, 0.0f);
+          for (int j : free)
+               warm->lambda[j] = bestLambda[j];
+     }
+     fractional = -1;
+     double worst = 0.0;
+     for (int j = 0; j < n; j++)
+     {
+          if (d[j] != FREE)
+          {
+               d_upper[j] = d[j];
+               continue;
+          }
+          double frac;
+          d_upper[j] = roundRow(&x[j * k], j, &frac);
+          if (frac > worst)
           {
-               obj += D_upper[j][i] * e[j][i] * w[j] / r_nk_e;
+               worst = frac;
+               fractional = j;
           }
      }
-     for (int i = 0; i < n; i++)
+     return best;
+}
+
+#ifdef EC_USE_GUROBI
+void buildModel(GRBModel &model, char vtype, vector<GRBVar> &D, vector<GRBConstr> &rows)
+{
+     D.resize(n * k + k);
+     for (int j = 0; j < n; j++)
      {
-          int is_edge = 0.0;
-          for (int j = 0; j < k; j++)
+          for (int i = 0; i < k; i++)
           {
-               is_edge += D_upper[i][j] * e[i][j];
+               ostringstream vname;
+               vname << "D_" << j << "_" << i;
+               D[j * k + i] = model.addVar(0.0, e[j][i], 0.0, vtype, vname.str());
           }
-          if (is_edge == 0)
-               obj += w[i] / r_nk_c;
      }
-     p.upper = obj;
-     return obj;
+
+     GRBQuadExpr obj = 0.0;
+     for (int j = 0; j < n; j++)
+     {
+          GRBLinExpr is_edge = 0.0;
+          for (int i = 0; i < k; i++)
+          {
+               if (!e[j][i])
+                    continue;
+               obj += D[j * k + i] * (w[j] / r_nk_e);
+               is_edge += D[j * k + i];
+          }
+          obj += (1 - is_edge) * w[j] / r_nk_c;
+
+          ostringstream cname;
+          cname << "c" << j;
+          rows.push_back(model.addConstr(is_edge <= 1, cname.str()));
+     }
+     // With y_i = sum_j D[j][i] sqrt(c[j]) the load cost is k diagonal terms
+     // y_i^2 / F[i], not the O(n^2) products of squaring the sums, so the
+     // model grows linearly in n
+     for (int i = 0; i < k; i++)
+     {
+          ostringstream vname, cname;
+          vname << "y_" << i;
+          cname << "load" << i;
+          GRBVar &y = D[n * k + i];
+          y = model.addVar(0.0, GRB_INFINITY, 0.0, GRB_CONTINUOUS, vname.str());
+          GRBLinExpr load = 0.0;
+          for (int j = 0; j < n; j++)
+               if (e[j][i])
+                    load += D[j * k + i] * sqrt(c[j]);
+          rows.push_back(model.addConstr(load == y, cname.str()));
+          obj.addTerm(1.0 / F[i], y, y);
+     }
+     model.setObjective(obj);
 }
 
-double calcProblem(node &p)
+GurobiRelaxation::GurobiRelaxation(GRBEnv &env) : model(env), curLB(n * k, 0.0), curUB(n * k)
 {
-     int Nd_num = p.Nd_num;
-     vector<vector<int>> d = p.d;
-     GRBEnv *env = 0;
+     buildModel(model, GRB_CONTINUOUS, D, rows);
+     for (int j = 0; j < n; j++)
+          for (int i = 0; i < k; i++)
+               curUB[j * k + i] = e[j][i];
+     // Children differ from their parent by bound changes only, so the
+     // parent's basis stays dual feasible and dual simplex can reuse it
+     if (opts.warmStart)
+          model.set(GRB_IntParam_Method, GRB_METHOD_DUAL);
+     model.update();
+}
 
-     // Create an environment
-     env = new GRBEnv();
-     GRBModel model = GRBModel(*env);
+double GurobiRelaxation::solve(const PartialAssignment &part, const WarmStart *start,
+                               Assignment &d_upper, WarmStart *warm)
+{
+     const Assignment &d = *part.d;
 
-     // Create variables
-     GRBVar **D = 0;
-     int dcnt = 0;
+     // Fixed rows take the node's decision, free rows get their full range
+     vector<GRBVar> vars;
+     vector<double> lbs, ubs;
+     for (int j = 0; j < n; j++)
+     {
+          for (int i = 0; i < k; i++)
+          {
+               int idx = j * k + i;
+               double lb = 0.0, ub = e[j][i];
+               if (d[j] != FREE)
+                    lb = ub = (d[j] == i) * e[j][i];
+               else if (isExcluded(part.excluded, j, i))
+                    ub = 0.0;
+               if (lb == curLB[idx] && ub == curUB[idx])
+                    continue;
+               curLB[idx] = lb;
+               curUB[idx] = ub;
+               vars.push_back(D[idx]);
+               lbs.push_back(lb);
+               ubs.push_back(ub);
+          }
+     }
+     if (!vars.empty())
+     {
+          model.set(GRB_DoubleAttr_LB, vars.data(), lbs.data(), (int)vars.size());
+          model.set(GRB_DoubleAttr_UB, vars.data(), ubs.data(), (int)vars.size());
+     }
 
-     try
+     if (start)
      {
-          D = new GRBVar *[n - Nd_num];
-          for (int i = 0; i < n - Nd_num; i++)
+          if (!start->vbasis.empty())
           {
-               D[i] = new GRBVar[k];
-               dcnt++;
+               vector<int> vb(start->vbasis.begin(), start->vbasis.end());
+               vector<int> cb(start->cbasis.begin(), start->cbasis.end());
+               model.set(GRB_IntAttr_VBasis, D.data(), vb.data(), (int)D.size());
+               model.set(GRB_IntAttr_CBasis, rows.data(), cb.data(), (int)rows.size());
           }
-          for (int i = 0; i < n - Nd_num; i++)
+          else if (!start->x.empty())
           {
-               for (int j = 0; j < k; j++)
-               {
-                    int tmp = i + Nd_num;
-                    ostringstream vname;
-                    vname << "D_" << tmp << j;
-                    D[i][j] = model.addVar(0.0, 1.0, 0.0, GRB_CONTINUOUS, vname.str());
-               }
+               vector<double> x0(start->x.begin(), start->x.end());
+               model.set(GRB_DoubleAttr_PStart, D.data(), x0.data(), n * k);
           }
+     }
 
-          double obj1 = 0.0;
-          for (int i = 0; i < k; i++)
+     model.optimize();
+     iterations += model.get(GRB_DoubleAttr_IterCount) + model.get(GRB_IntAttr_BarIterCount);
+
+     double *x = model.get(GRB_DoubleAttr_X, D.data(), n * k);
+     if (warm)
+     {
+          try
           {
-               double tmp = 0.0;
-               for (int j = 0; j < Nd_num; j++)
-               {
-                    tmp += d[j][i] * e[j][i] * sqrt(c[j]);
-               }
-               obj1 += tmp * tmp / F[i];
+               int *vb = model.get(GRB_IntAttr_VBasis, D.data(), (int)D.size());
+               int *cb = model.get(GRB_IntAttr_CBasis, rows.data(), (int)rows.size());
+               warm->vbasis.assign(vb, vb + D.size());
+               warm->cbasis.assign(cb, cb + rows.size());
+               delete[] vb;
+               delete[] cb;
           }
-          for (int i = 0; i < k; i++)
+          catch (GRBException)
           {
-               for (int j = 0; j < Nd_num; j++)
-               {
-                    obj1 += d[j][i] * e[j][i] * w[j] / r_nk_e;
-               }
+               // No basis (e.g. barrier without crossover), the primal start will do
+               warm->x.assign(x, x + n * k);
           }
-          for (int i = 0; i < Nd_num; i++)
+     }
+
+     // Reduced-cost bounds: with the gradient A'pi + rc at the optimum and
+     // convexity, a completion costs at least obj + rc_ji (1 - x_ji) with D_ji
+     // set, and obj - pi_j - sum_i rc_ji x_ji with row j in the cloud
+     double obj = model.get(GRB_DoubleAttr_ObjVal);
+     optionLower.clear();
+     if (opts.reducedCost && model.get(GRB_IntAttr_Status) == GRB_OPTIMAL)
+     {
+          double *rc = model.get(GRB_DoubleAttr_RC, D.data(), n * k);
+          double *pi = model.get(GRB_DoubleAttr_Pi, rows.data(), n);
+          optionLower.resize(n * (k + 1));
+          for (int j = 0; j < n; j++)
           {
-               double is_edge = 0.0;
-               for (int j = 0; j < k; j++)
+               if (d[j] != FREE)
+                    continue;
+               double cloud = obj - pi[j];
+               for (int i = 0; i < k; i++)
                {
-                    is_edge += d[i][j] * e[i][j];
+                    int idx = j * k + i;
+                    cloud -= rc[idx] * x[idx];
+                    optionLower[j * (k + 1) + i + 1] = obj + rc[idx] * (1.0 - x[idx]);
                }
-               if (is_edge == 0)
-                    obj1 += w[i] / r_nk_c;
+               optionLower[j * (k + 1)] = cloud;
           }
+          delete[] rc;
+          delete[] pi;
+     }
 
-          GRBQuadExpr obj2 = 0.0;
-          for (int i = 0; i < k; i++)
+     fractional = -1;
+     double worst = 0.0;
+     for (int j = 0; j < n; j++)
+     {
+          if (d[j] != FREE)
           {
-               GRBLinExpr tmp = 0.0;
-               for (int j = 0; j < n - Nd_num; j++)
-               {
-                    tmp += D[j][i] * e[j + Nd_num][i] * sqrt(c[j]);
-               }
-               obj2 += tmp * tmp / F[i];
+               d_upper[j] = d[j];
+               continue;
           }
-          GRBLinExpr obj3 = 0.0;
-          for (int i = 0; i < k; i++)
+          if (opts.verbose)
+               for (int i = 0; i < k; i++)
+                    cout << "D_" << j << "_" << i << " " << x[j * k + i] << endl;
+          double frac;
+          d_upper[j] = roundRow(&x[j * k], j, &frac);
+          if (frac > worst)
           {
-               for (int j = 0; j < n - Nd_num; j++)
-               {
-                    obj3 += D[j][i] * e[j + Nd_num][i] * w[j + Nd_num] / r_nk_e;
-               }
+               worst = frac;
+               fractional = j;
+          }
+     }
+     delete[] x;
+     return obj;
+}
+
+// Links Gurobi's branch-and-cut to our incumbent: its new solutions are
+// offered to it, ours are handed to Gurobi whenever they are better than
+// its own, and the progress is printed every few seconds
+class MIQPCallback : public GRBCallback
+{
+public:
+     MIQPCallback(Incumbent &incumbent, const vector<GRBVar> &D)
+         : incumbent(incumbent), D(D), none(n, FREE), noLoad(k, 0.0), allFree(n), d(n, CLOUD), start(n * k)
+     {
+          iota(allFree.begin(), allFree.end(), 0);
+          root = {&none, 0, noLoad.data(), 0.0, &allFree};
+     }
+
+protected:
+     void callback() override
+     {
+          if (where == GRB_CB_MIPSOL)
+          {
+               double *x = getSolution(D.data(), n * k);
+               for (int j = 0; j < n; j++)
+                    d[j] = roundRow(&x[j * k], j);
+               delete[] x;
+               if (incumbent.offer(calcTargetVal(d, root, scratch), d) && opts.verbose)
+                    cout << "new incumbent: " << incumbent.get() << endl;
           }
-          for (int i = 0; i < n - Nd_num; i++)
+          else if (where == GRB_CB_MIPNODE && getIntInfo(GRB_CB_MIPNODE_STATUS) == GRB_OPTIMAL)
           {
-               GRBLinExpr is_edge = 0.0;
-               for (int j = 0; j < k; j++)
-               {
-                    is_edge += D[i][j] * e[i + Nd_num][j];
-               }
-               obj3 += (1 - is_edge) * w[i + Nd_num] / r_nk_c;
+               // As in the branch-and-bound, every heuristicFreq-th node
+               // relaxation is rounded and improved by local search; the
+               // incumbent is handed to Gurobi once it beats Gurobi's own
+               if (!opts.heuristics || opts.heuristicFreq == 0 || relaxations++ % opts.heuristicFreq != 0)
+                    return;
+               double *x = getNodeRel(D.data(), n * k);
+               for (int j = 0; j < n; j++)
+                    d[j] = roundRow(&x[j * k], j);
+               delete[] x;
+               if (incumbent.offer(localSearch(root, d, load), d) && opts.verbose)
+                    cout << "new incumbent: " << incumbent.get() << endl;
+               double value = incumbent.get();
+               if (value >= injected || value >= getDoubleInfo(GRB_CB_MIPNODE_OBJBST) - 1e-9)
+                    return;
+               injected = value;
+               Assignment best = incumbent.assignment();
+               fill(start.begin(), start.end(), 0.0);
+               for (int j = 0; j < n; j++)
+                    if (best[j] != CLOUD)
+                         start[j * k + best[j]] = 1.0;
+               setSolution(D.data(), start.data(), n * k);
+               useSolution();
           }
-          if (n == Nd_num)
+          else if (where == GRB_CB_MIP)
           {
-               cout << "target::::::" << obj1 + obj2 + obj3 << endl;
+               double time = getDoubleInfo(GRB_CB_RUNTIME);
+               if (time < lastReport + 5.0)
+                    return;
+               lastReport = time;
+               cout << "miqp: " << (long long)time << " s, nodes " << getDoubleInfo(GRB_CB_MIP_NODCNT)
+                    << ", incumbent " << incumbent.get() + pre.offset << ", bound "
+                    << getDoubleInfo(GRB_CB_MIP_OBJBND) + pre.offset << endl;
           }
+     }
 
-          model.setObjective(obj1 + obj2 + obj3);
+private:
+     Incumbent &incumbent;
+     const vector<GRBVar> &D;
+     Assignment none;
+     vector<double> noLoad;
+     vector<int> allFree;
+     PartialAssignment root;
+     Assignment d;
+     vector<double> scratch, load, start;   // start: solution handed to Gurobi
+     long long relaxations = 0;              // node relaxations seen
+     double injected = numeric_limits<double>::infinity();
+     double lastReport = 0.0;
+};
 
-          GRBLinExpr constr1 = 0.0;
-          for (int i = 0; i < n - Nd_num; i++)
-          {
-               GRBLinExpr constr = 0.0;
-               ostringstream cname;
-               cname << "c" << i;
-               for (int j = 0; j < k; j++)
-               {
-                    constr += D[i][j] * e[i + Nd_num][j];
-               }
-               model.addConstr(constr <= 1, cname.str());
-          }
+// The whole problem as one MIQP with binary D, left to Gurobi's
+// branch-and-cut and heuristics, started from incumbent; Gurobi gets the
+// time left of the limit counted from since
+EngineStats solveMIQP(Incumbent &incumbent, chrono::steady_clock::time_point since)
+{
+     auto start = chrono::high_resolution_clock::now();
+     GRBEnv env(true);
+     env.set(GRB_IntParam_OutputFlag, opts.verbose ? 1 : 0);
+     env.set(GRB_IntParam_Threads, opts.threads);
+     if (opts.timeLimit > 0.0)
+     {
+          double spent = chrono::duration<double>(chrono::steady_clock::now() - since).count();
+          env.set(GRB_DoubleParam_TimeLimit, max(0.0, opts.timeLimit - spent));
+     }
+     if (opts.nodeLimit > 0)
+          env.set(GRB_DoubleParam_NodeLimit, (double)opts.nodeLimit);
+     env.set(GRB_DoubleParam_MIPGap, opts.gap);
+     env.set(GRB_DoubleParam_MIPGapAbs, opts.absGap);
+     env.start();
+     GRBModel model(env);
+     vector<GRBVar> D;
+     vector<GRBConstr> rows;
+     buildModel(model, GRB_BINARY, D, rows);
 
-          // Optimize model
-          model.optimize();
-          vector<vector<int>> D_upper = p.d;
+     Assignment best = incumbent.assignment();
+     vector<double> x0(n * k, 0.0);
+     for (int j = 0; j < n; j++)
+          if (best[j] != CLOUD)
+               x0[j * k + best[j]] = 1.0;
+     model.update();
+     model.set(GRB_DoubleAttr_Start, D.data(), x0.data(), n * k);
 
-          for (int i = 0; i < n - Nd_num; i++)
+     MIQPCallback cb(incumbent, D);
+     model.setCallback(&cb);
+     model.optimize();
+
+     EngineStats st;
+     st.value = incumbent.get();
+     st.bound = model.get(GRB_IntAttr_SolCount) > 0 ? model.get(GRB_DoubleAttr_ObjBound) : st.value;
+     st.nodes = model.get(GRB_DoubleAttr_NodeCount);
+     switch (model.get(GRB_IntAttr_Status))
+     {
+     case GRB_TIME_LIMIT:
+          st.status = "time limit";
+          break;
+     case GRB_NODE_LIMIT:
+          st.status = "node limit";
+          break;
+     default:
+          if (st.bound < st.value - 1e-9)
+               st.status = "gap reached";
+     }
+     st.ms = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count();
+     return st;
+}
+#endif
+
+// Lower bound of the node part, rounded solution in wk.d_upper, and the
+// relaxation's optionLower in optionLower, null if it has none. The
+// cascade tries the analytic bound first (the fixed part was checked by
+// processNode) and solves the relaxation only if that cannot prune.
+double calcProblem(Worker &wk, const PartialAssignment &part, const WarmStart *start,
+                   shared_ptr<const WarmStart> &warm, double cutoff, const vector<double> *&optionLower)
+{
+     optionLower = nullptr;
+     if (opts.cascade)
+     {
+          double quick = analyticBound(part, wk.servers);
+          if (quick > cutoff)
           {
-               vector<int> tmp;
-               for (int j = 0; j < k; j++)
-               {
-                    cout << D[i][j].get(GRB_StringAttr_VarName) << " "
-                         << D[i][j].get(GRB_DoubleAttr_X) << endl;
-                    tmp.push_back((int)round(D[i][j].get(GRB_DoubleAttr_X)));
-               }
-               D_upper.push_back(tmp);
+               wk.tierPruned[1]++;
+               wk.fractional = -1;
+               for (int j = 0; j < n; j++)
+                    wk.d_upper[j] = (*part.d)[j] != FREE ? (*part.d)[j] : CLOUD;
+               warm.reset();
+               return quick;
           }
+     }
 
-          for (int i = 0; i < n; i++)
+     double lower = 0.0;
+     bool failed = false;
+     wk.solved++;
+     shared_ptr<WarmStart> own;
+     if (opts.warmStart)
+          own = make_shared<WarmStart>();
+     try
+     {
+          // The Lagrangian bound decides first; the QP only runs on the
+          // nodes it cannot prune
+          lower = -numeric_limits<double>::infinity();
+          if (wk.lagrangian)
           {
-               for (int j = 0; j < k; j++)
-               {
-                    cout << D_upper[i][j] << " ";
-               }
-               cout << endl;
+               wk.lagrangian->cutoff = cutoff;
+               lower = wk.lagrangian->solve(part, start, wk.d_upper, own.get());
+               wk.fractional = wk.lagrangian->fractional;
           }
-
-          cout << "Obj: " << model.get(GRB_DoubleAttr_ObjVal) << endl;
-          p.lower = model.get(GRB_DoubleAttr_ObjVal);
-          p.d_upper = D_upper;
+          if (wk.relax && lower <= cutoff)
+          {
+               wk.relax->cutoff = cutoff;
+               lower = max(lower, wk.relax->solve(part, start, wk.d_upper, own.get()));
+               wk.fractional = wk.relax->fractional;
+               if (!wk.relax->optionLower.empty())
+                    optionLower = &wk.relax->optionLower;
+          }
+          if (lower > cutoff)
+               wk.tierPruned[2]++;
+          if (own)
+               own->count();
+          warm = own;
      }
+#ifdef EC_USE_GUROBI
      catch (GRBException e)
      {
           cout << "Error code = " << e.getErrorCode() << endl;
           cout << e.getMessage() << endl;
+          failed = true;
+     }
+#endif
+     catch (const exception &ex)
+     {
+          cout << ex.what() << endl;
+          failed = true;
+     }
+     if (failed)
+     {
+          // Fall back to the trivial bound and send the free queries to the cloud
+          lower = 0.0;
+          wk.fractional = -1;
+          optionLower = nullptr;
+          for (int j = 0; j < n; j++)
+               wk.d_upper[j] = (*part.d)[j] != FREE ? (*part.d)[j] : CLOUD;
      }
-     catch (...)
+
+     if (opts.verbose)
      {
-          cout << "Exception during optimization" << endl;
+          for (int i = 0; i < n; i++)
+          {
+               for (int j = 0; j < k; j++)
+               {
+                    cout << (wk.d_upper[i] == j ? 1 : 0) << " ";
+               }
+               cout << endl;
+          }
+          cout << "Obj: " << lower << endl;
+          cout << "----------------------------------" << endl;
      }
-     for (int i = 0; i < dcnt; ++i)
+     return lower;
+}
+
+inline bool isExcluded(const Exclusions *ex, int j, int i)
+{
+     size_t bit = (size_t)j * (k + 1) + i + 1;
+     return ex && ((*ex)[bit >> 6] >> (bit & 63) & 1);
+}
+
+// Reduced-cost fixing: the options of the free queries whose bound from the
+// relaxation just solved (optionLower, see calcProblem) exceeds the incumbent have no completion worth
+// searching, so they are excluded in the whole subtree, on top of the
+// inherited ones. The set is copied only when it grows.
+shared_ptr<const Exclusions> fixByReducedCost(Worker &wk, const vector<double> *optionLower, const vector<int> &free,
+                                              const shared_ptr<const Exclusions> &inherited, double upper)
+{
+     if (!optionLower)
+          return inherited;
+     const vector<double> &bound = *optionLower;
+     shared_ptr<Exclusions> own;
+     for (int j : free)
      {
-          delete[] D[i];
+          for (int i = CLOUD; i < k; i++)
+          {
+               size_t bit = (size_t)j * (k + 1) + i + 1;
+               if ((i != CLOUD && !e[j][i]) || bound[bit] <= upper || isExcluded(inherited.get(), j, i))
+                    continue;
+               if (!own)
+                    own = inherited ? make_shared<Exclusions>(*inherited)
+                                    : make_shared<Exclusions>((n * (k + 1) + 63) / 64, 0);
+               (*own)[bit >> 6] |= 1ULL << (bit & 63);
+               wk.rcFixed++;
+          }
      }
-     delete[] D;
-     cout << "----------------------------------" << endl;
-     delete env;
-     return model.get(GRB_DoubleAttr_ObjVal);
+     if (own)
+          return own;
+     return inherited;
 }
 
 vector<vector<int>> readMatrixFromFile(const string& filename, int rows, int cols) {
@@ -449,6 +4183,7 @@ void initializeParameters() {
     cin >> n;
     cout << "Enter the number of ESs (k): ";
     cin >> k;
+    edge_servers_ip.resize(k);
 
     // Get user input for 'r_nk_e' and 'r_nk_c'
     cout << "Enter cloud server ip: ";
@@ -477,4 +4212,117 @@ void initializeParameters() {
     c = readVectorFromFile(vectorCFile, n);
     w = readVectorFromFile(vectorWFile, n);
     F = readVectorFromFile(vectorFFile, k);
-}
\ No newline at end of file
+}
+void parseOptions(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--search=bfs") {
+            opts.search = SEARCH_BFS;
+        } else if (arg == "--search=best") {
+            opts.search = SEARCH_BEST;
+        } else if (arg == "--branch=input") {
+            opts.branch = BRANCH_INPUT;
+        } else if (arg == "--branch=impact") {
+            opts.branch = BRANCH_IMPACT;
+        } else if (arg == "--branch=fractional") {
+            opts.branch = BRANCH_FRACTIONAL;
+        } else if (arg == "--branch=pseudocost") {
+            opts.branch = BRANCH_PSEUDOCOST;
+        } else if (arg == "--engine=bb") {
+            opts.engine = ENGINE_BB;
+        } else if (arg == "--engine=lns") {
+            opts.engine = ENGINE_LNS;
+        } else if (arg.compare(0, 11, "--lns-size=") == 0) {
+            opts.lnsSize = max(1, atoi(arg.c_str() + 11));
+        } else if (arg.compare(0, 12, "--lns-nodes=") == 0) {
+            opts.lnsNodes = max(1LL, atoll(arg.c_str() + 12));
+        } else if (arg == "--engine=miqp" || arg == "--engine=both") {
+#ifdef EC_USE_GUROBI
+            opts.engine = arg == "--engine=miqp" ? ENGINE_MIQP : ENGINE_BOTH;
+#else
+            cerr << "This build has no Gurobi support" << endl;
+            exit(1);
+#endif
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            opts.threads = max(1, atoi(arg.c_str() + 10));
+        } else if (arg == "--backend=native") {
+            opts.backend = BACKEND_NATIVE;
+        } else if (arg == "--backend=gurobi") {
+#ifdef EC_USE_GUROBI
+            opts.backend = BACKEND_GUROBI;
+#else
+            cerr << "This build has no Gurobi support" << endl;
+            exit(1);
+#endif
+        } else if (arg.compare(0, 15, "--native-iters=") == 0) {
+            opts.nativeIters = max(1, atoi(arg.c_str() + 15));
+        } else if (arg.compare(0, 13, "--native-tol=") == 0) {
+            opts.nativeTol = atof(arg.c_str() + 13);
+        } else if (arg == "--bound=qp") {
+            opts.bound = BOUND_QP;
+        } else if (arg == "--bound=lagrangian") {
+            opts.bound = BOUND_LAGRANGIAN;
+        } else if (arg == "--bound=auto") {
+            opts.bound = BOUND_AUTO;
+        } else if (arg.compare(0, 17, "--lagrange-iters=") == 0) {
+            opts.lagrangeIters = max(1, atoi(arg.c_str() + 17));
+        } else if (arg == "--no-warm-start") {
+            opts.warmStart = false;
+        } else if (arg == "--no-heuristics") {
+            opts.heuristics = false;
+        } else if (arg.compare(0, 17, "--heuristic-freq=") == 0) {
+            opts.heuristicFreq = max(0, atoi(arg.c_str() + 17));
+        } else if (arg == "--no-symmetry") {
+            opts.symmetry = false;
+        } else if (arg.compare(0, 13, "--time-limit=") == 0) {
+            opts.timeLimit = max(0.0, atof(arg.c_str() + 13));
+        } else if (arg.compare(0, 13, "--node-limit=") == 0) {
+            opts.nodeLimit = max(0LL, atoll(arg.c_str() + 13));
+        } else if (arg.compare(0, 6, "--gap=") == 0) {
+            opts.gap = max(0.0, atof(arg.c_str() + 6));
+        } else if (arg.compare(0, 10, "--abs-gap=") == 0) {
+            opts.absGap = max(0.0, atof(arg.c_str() + 10));
+        } else if (arg == "--no-lazy") {
+            opts.lazy = false;
+        } else if (arg == "--no-rc-fixing") {
+            opts.reducedCost = false;
+        } else if (arg == "--no-cascade") {
+            opts.cascade = false;
+        } else if (arg.compare(0, 13, "--checkpoint=") == 0) {
+            opts.checkpoint = arg.substr(13);
+        } else if (arg.compare(0, 19, "--checkpoint-every=") == 0) {
+            opts.checkpointEvery = max(0.1, atof(arg.c_str() + 19));
+        } else if (arg.compare(0, 8, "--serve=") == 0) {
+            opts.serve = atoi(arg.c_str() + 8);
+        } else if (arg.compare(0, 10, "--connect=") == 0) {
+            opts.connect = arg.substr(10);
+        } else if (arg.compare(0, 13, "--dist-nodes=") == 0) {
+            opts.distNodes = max(1LL, atoll(arg.c_str() + 13));
+        } else if (arg == "--resume") {
+            opts.resume = true;
+        } else if (arg.compare(0, 9, "--mem-mb=") == 0) {
+            opts.memMB = max(0LL, atoll(arg.c_str() + 9));
+        } else if (arg.compare(0, 8, "--tt-mb=") == 0) {
+            opts.ttMB = max(0, atoi(arg.c_str() + 8));
+        } else if (arg == "--no-presolve") {
+            opts.presolve = false;
+        } else if (arg == "--verbose") {
+            opts.verbose = true;
+        } else {
+            cerr << "Unknown option: " << arg << endl;
+            cerr << "Usage: " << argv[0] << " [--engine=bb|miqp|both|lns] [--lns-size=N] [--lns-nodes=N] [--search=best|bfs]"
+                 << " [--branch=input|impact|fractional|pseudocost] [--threads=N] [--backend=gurobi|native]"
+                 << " [--native-iters=N] [--native-tol=X]"
+                 << " [--bound=qp|lagrangian|auto] [--lagrange-iters=N] [--no-warm-start]"
+                 << " [--no-heuristics] [--heuristic-freq=N] [--no-symmetry] [--no-presolve] [--no-lazy] [--no-cascade] [--no-rc-fixing] [--tt-mb=N] [--mem-mb=N]"
+                 << " [--checkpoint=FILE] [--checkpoint-every=S] [--resume]"
+                 << " [--serve=PORT] [--connect=HOST:PORT] [--dist-nodes=N]"
+                 << " [--time-limit=S] [--node-limit=N] [--gap=X] [--abs-gap=X] [--verbose]" << endl;
+            exit(1);
+        }
+    }
+    if (opts.resume && opts.checkpoint.empty()) {
+        cerr << "--resume needs --checkpoint=FILE" << endl;
+        exit(1);
+    }
+}
@@ -0,0 +1,83 @@
+#!/bin/sh
+# Solves a small instance with a coordinator and three workers on this host
+# and checks that they find the target of the single process.
+# usage: distributed.sh BINARY
+set -e
+bin=$1
+dir=$(mktemp -d)
+pids=
+trap 'kill $pids 2>/dev/null || true; rm -rf "$dir"' EXIT
+cd "$dir"
+
+# iperf stand-in: 20 Mbit/s to the cloud, 80 Mbit/s to the edge servers
+mkdir bin
+cat > bin/iperf <<'EOF'
+#!/bin/sh
+case "$2" in
+    cloud) echo "[  3]  0.0-10.0 sec  100 MBytes  20.0 Mbits/sec " ;;
+    *) echo "[  3]  0.0-10.0 sec  100 MBytes  80.0 Mbits/sec " ;;
+esac
+EOF
+chmod +x bin/iperf
+PATH="$dir/bin:$PATH"
+
+# 12 queries, 4 servers
+printf '1 1 0 1\n1 0 1 1\n0 1 1 0\n1 1 1 1\n1 1 0 0\n0 1 0 1\n0 1 1 1\n1 0 1 0\n1 1 1 0\n0 0 1 1\n1 0 0 1\n1 1 0 1\n' > e.txt
+printf '16\n25\n9\n36\n4\n12\n49\n1\n20\n30\n8\n14\n' > c.txt
+printf '120\n300\n80\n450\n200\n150\n60\n350\n90\n240\n500\n70\n' > w.txt
+printf '60\n60\n90\n45\n' > f.txt
+echo "12 4 cloud edge0 edge1 edge2 edge3 e.txt c.txt w.txt f.txt" > in.txt
+
+target() {
+    grep "^bestTarget:" "$1" | awk '{print $2}'
+}
+
+"$bin" --threads=1 < in.txt > single.txt
+expected=$(target single.txt)
+
+# The coordinator skips the heuristics so that the workers find the target;
+# a port taken by another process makes it exit, and the next one is tried
+for port in 47311 47312 47313 47314 47315; do
+    "$bin" --serve=$port --threads=1 --no-heuristics < in.txt > coordinator.txt 2>&1 &
+    coordinator=$!
+    pids="$pids $coordinator"
+    tries=0
+    while kill -0 $coordinator 2>/dev/null && ! grep -q "^coordinator listening" coordinator.txt; do
+        tries=$((tries + 1))
+        [ $tries -lt 300 ] || break
+        sleep 0.1
+    done
+    grep -q "^coordinator listening" coordinator.txt && break
+    kill $coordinator 2>/dev/null || true
+    wait $coordinator || true
+    coordinator=
+done
+[ -n "$coordinator" ] || {
+    echo "coordinator did not start:"
+    cat coordinator.txt
+    exit 1
+}
+
+# Batches of 20 nodes, so that the tree is split between the workers
+workers=
+for i in 1 2 3; do
+    "$bin" --connect=localhost:$port --threads=1 --dist-nodes=20 < in.txt > worker$i.txt 2>&1 &
+    workers="$workers $!"
+    pids="$pids $!"
+done
+wait $coordinator || true
+for pid in $workers; do
+    wait $pid || true
+done
+
+actual=$(target coordinator.txt)
+[ -n "$expected" ] && [ "$actual" = "$expected" ] || {
+    echo "distributed bestTarget '$actual', single process '$expected':"
+    cat coordinator.txt
+    exit 1
+}
+grep -q "^distributed: .*open nodes returned: [1-9]" coordinator.txt || {
+    echo "the workers did not share the search:"
+    cat coordinator.txt
+    exit 1
+}
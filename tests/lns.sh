@@ -0,0 +1,56 @@
+#!/bin/sh
+# Runs the large neighborhood search for a second on an instance of 2000
+# queries and 16 servers and checks that a neighborhood improved the
+# heuristic incumbent.
+# usage: lns.sh BINARY
+set -e
+bin=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+# iperf stand-in: 20 Mbit/s to the cloud, 80 Mbit/s to the edge servers
+mkdir bin
+cat > bin/iperf <<'EOF'
+#!/bin/sh
+case "$2" in
+    cloud) echo "[  3]  0.0-10.0 sec  100 MBytes  20.0 Mbits/sec " ;;
+    *) echo "[  3]  0.0-10.0 sec  100 MBytes  80.0 Mbits/sec " ;;
+esac
+EOF
+chmod +x bin/iperf
+PATH="$dir/bin:$PATH"
+
+# Pseudo-random instance: a query runs on a server with probability 0.6
+awk -v n=2000 -v k=16 'BEGIN {
+    x = 12345
+    for (j = 0; j < n; j++) {
+        row = ""
+        for (i = 0; i < k; i++) {
+            x = (x * 1103515245 + 12345) % 2147483648
+            row = row (i ? " " : "") (x % 10 < 6 ? 1 : 0)
+        }
+        print row > "e.txt"
+        x = (x * 1103515245 + 12345) % 2147483648
+        print 1 + x % 100 > "c.txt"
+        x = (x * 1103515245 + 12345) % 2147483648
+        print 1 + x % 500 > "w.txt"
+    }
+    for (i = 0; i < k; i++) {
+        x = (x * 1103515245 + 12345) % 2147483648
+        print 50 + x % 150 > "f.txt"
+    }
+    printf "%d %d cloud", n, k
+    for (i = 0; i < k; i++)
+        printf " edge%d", i
+    print " e.txt c.txt w.txt f.txt"
+}' > in.txt
+
+"$bin" --engine=lns < in.txt > out.txt
+# lns: ... improved random a/b, server c/d, cost e/f, loaded g/h by ...
+improved=$(grep "^lns:" out.txt | sed 's/.*improved//; s/ by .*//' | tr ',' '\n' | awk '{ split($2, f, "/"); s += f[1] } END { print s + 0 }')
+[ "$improved" -gt 0 ] || {
+    echo "no neighborhood improved:"
+    grep -v "^[0-9. ]*$" out.txt
+    exit 1
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Solves a small instance with the default options and checks that the
+# search allocated its transposition table (--tt-mb=16 unless turned off).
+# usage: transposition_table.sh BINARY
+set -e
+bin=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+# iperf stand-in: 20 Mbit/s to the cloud, 80 Mbit/s to the edge servers
+mkdir bin
+cat > bin/iperf <<'EOF'
+#!/bin/sh
+case "$2" in
+    cloud) echo "[  3]  0.0-10.0 sec  100 MBytes  20.0 Mbits/sec " ;;
+    *) echo "[  3]  0.0-10.0 sec  100 MBytes  80.0 Mbits/sec " ;;
+esac
+EOF
+chmod +x bin/iperf
+PATH="$dir/bin:$PATH"
+
+# 8 queries, 3 servers; queries 0-1 and 4-5 are duplicates
+printf '1 1 0\n1 0 1\n0 1 1\n1 1 1\n1 1 0\n1 1 0\n0 1 1\n1 0 1\n' > e.txt
+printf '16\n25\n9\n36\n4\n4\n49\n1\n' > c.txt
+printf '120\n300\n80\n450\n200\n200\n60\n350\n' > w.txt
+printf '60\n60\n90\n' > f.txt
+
+out=$(echo "8 3 cloud edge0 edge1 edge2 e.txt c.txt w.txt f.txt" | "$bin" --threads=1 --no-heuristics)
+echo "$out" | grep -q "^transpositions pruned: .* (table 16 MiB)" || {
+    echo "transposition table not allocated:"
+    echo "$out"
+    exit 1
+}
+off=$(echo "8 3 cloud edge0 edge1 edge2 e.txt c.txt w.txt f.txt" | "$bin" --threads=1 --no-heuristics --tt-mb=0)
+if echo "$off" | grep -q "^transpositions pruned"; then
+    echo "transposition table allocated with --tt-mb=0"
+    exit 1
+fi